@@ -16,6 +16,7 @@
 
 #include "mt7601u.h"
 #include "eeprom.h"
+#include "usb.h"
 
 static int
 mt76_reg_set(void *data, u64 val)
@@ -94,6 +95,592 @@ static const struct file_operations fops_ampdu_stat = {
 	.release = single_release,
 };
 
+static int
+mt7601u_tx_batch_read(struct seq_file *file, void *data)
+{
+	struct mt7601u_dev *dev = file->private;
+	struct mt7601u_tx_batch_stats *st = &dev->tx_batch;
+	int i;
+
+	seq_printf(file, "batches:\t%llu\n", st->batches);
+	seq_printf(file, "frames:\t\t%llu\n", st->skbs);
+	seq_printf(file, "max batch:\t%u\n", st->max);
+
+	seq_puts(file, "Batch size histogram:\n");
+	for (i = 0; i < MT_TX_BATCH_HIST - 1; i++)
+		seq_printf(file, "\t%u-%u:\t%llu\n",
+			   1 << i, (2 << i) - 1, st->hist[i]);
+	seq_printf(file, "\t%u+:\t%llu\n", 1 << i, st->hist[i]);
+
+	return 0;
+}
+
+static int
+mt7601u_tx_batch_open(struct inode *inode, struct file *f)
+{
+	return single_open(f, mt7601u_tx_batch_read, inode->i_private);
+}
+
+static const struct file_operations fops_tx_batch = {
+	.open = mt7601u_tx_batch_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int
+mt7601u_tx_status_read(struct seq_file *file, void *data)
+{
+	struct mt7601u_dev *dev = file->private;
+	struct mt7601u_tx_status_stats *st = &dev->tx_status_stats;
+
+	seq_printf(file, "pending:\t%d\n", atomic_read(&dev->tx_pending));
+	seq_printf(file, "matched:\t%llu\n", st->matched);
+	seq_printf(file, "noskb:\t\t%llu\n", st->noskb);
+	seq_printf(file, "expired:\t%llu\n", st->expired);
+	seq_printf(file, "purged:\t\t%llu\n", st->purged);
+	seq_printf(file, "lost (req status):\t%llu\n", st->lost_req_status);
+	seq_printf(file, "polls:\t\t%llu\n", st->polls);
+	seq_printf(file, "fifo full:\t%llu\n", st->fifo_full);
+	seq_printf(file, "poll interval:\t%ums\n", dev->tx_stat_poll.interval);
+	seq_printf(file, "entries/s:\t%u\n",
+		   (dev->tx_stat_poll.rate * 1000) >> MT_TX_STAT_RATE_SHIFT);
+
+	return 0;
+}
+
+static int
+mt7601u_tx_status_open(struct inode *inode, struct file *f)
+{
+	return single_open(f, mt7601u_tx_status_read, inode->i_private);
+}
+
+static const struct file_operations fops_tx_status = {
+	.open = mt7601u_tx_status_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int
+mt7601u_tx_flush_read(struct seq_file *file, void *data)
+{
+	struct mt7601u_dev *dev = file->private;
+	struct mt7601u_flush_stats *st = &dev->flush_stats;
+
+	seq_printf(file, "flushes:\t%u\n", st->n);
+	seq_printf(file, "with drop:\t%u\n", st->n_drop);
+	seq_printf(file, "timeouts:\t%u\n", st->n_timeout);
+	seq_printf(file, "last:\t\t%uus\n", st->last_us);
+	seq_printf(file, "max:\t\t%uus\n", st->max_us);
+	seq_printf(file, "avg:\t\t%lluus\n",
+		   st->n ? div_u64(st->total_us, st->n) : 0);
+
+	return 0;
+}
+
+static int
+mt7601u_tx_flush_open(struct inode *inode, struct file *f)
+{
+	return single_open(f, mt7601u_tx_flush_read, inode->i_private);
+}
+
+static const struct file_operations fops_tx_flush = {
+	.open = mt7601u_tx_flush_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int
+mt7601u_tx_lat_read(struct seq_file *file, void *data)
+{
+	static const char * const ac_name[] = {
+		[IEEE80211_AC_VO] = "VO",
+		[IEEE80211_AC_VI] = "VI",
+		[IEEE80211_AC_BE] = "BE",
+		[IEEE80211_AC_BK] = "BK",
+	};
+	static const char * const stage_name[] = {
+		[MT_TX_LAT_QUEUE] = "queue",
+		[MT_TX_LAT_USB] = "usb",
+		[MT_TX_LAT_STATUS] = "status",
+	};
+	struct mt7601u_dev *dev = file->private;
+	int i, j, k;
+
+	seq_puts(file, "us <\t");
+	for (k = 0; k < MT_TX_LAT_HIST - 1; k++)
+		seq_printf(file, "%8u ", 1 << k);
+	seq_puts(file, "     inf\n");
+
+	for (i = 0; i < IEEE80211_NUM_ACS; i++)
+		for (j = 0; j < __MT_TX_LAT_MAX; j++) {
+			seq_printf(file, "%s %s\t", ac_name[i], stage_name[j]);
+			for (k = 0; k < MT_TX_LAT_HIST; k++)
+				seq_printf(file, "%8u ",
+					   dev->tx_lat.hist[i][j][k]);
+			seq_putc(file, '\n');
+		}
+
+	return 0;
+}
+
+static int
+mt7601u_tx_lat_open(struct inode *inode, struct file *f)
+{
+	return single_open(f, mt7601u_tx_lat_read, inode->i_private);
+}
+
+/* Any write resets the histograms */
+static ssize_t
+mt7601u_tx_lat_write(struct file *f, const char __user *buf, size_t count,
+		     loff_t *ppos)
+{
+	struct mt7601u_dev *dev = ((struct seq_file *)f->private_data)->private;
+
+	memset(&dev->tx_lat, 0, sizeof(dev->tx_lat));
+
+	return count;
+}
+
+static const struct file_operations fops_tx_lat = {
+	.open = mt7601u_tx_lat_open,
+	.read = seq_read,
+	.write = mt7601u_tx_lat_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int
+mt7601u_rx_cost_read(struct seq_file *file, void *data)
+{
+	struct mt7601u_dev *dev = file->private;
+	struct mt7601u_rx_cost *cost = &dev->rx_cost;
+
+	seq_printf(file, "enabled:\t%u\n", cost->enabled);
+	seq_printf(file, "frames:\t\t%llu\n", cost->frames);
+	seq_printf(file, "avg_ns:\t\t%llu\n", cost->frames ?
+		   div64_u64(cost->time_ns, cost->frames) : 0);
+	seq_printf(file, "max_ns:\t\t%u\n", cost->max_ns);
+
+	return 0;
+}
+
+static int
+mt7601u_rx_cost_open(struct inode *inode, struct file *f)
+{
+	return single_open(f, mt7601u_rx_cost_read, inode->i_private);
+}
+
+/* Any write resets the counters */
+static ssize_t
+mt7601u_rx_cost_write(struct file *f, const char __user *buf,
+		      size_t count, loff_t *ppos)
+{
+	struct mt7601u_dev *dev = ((struct seq_file *)f->private_data)->private;
+
+	dev->rx_cost.frames = 0;
+	dev->rx_cost.time_ns = 0;
+	dev->rx_cost.max_ns = 0;
+
+	return count;
+}
+
+static const struct file_operations fops_rx_cost = {
+	.open = mt7601u_rx_cost_open,
+	.read = seq_read,
+	.write = mt7601u_rx_cost_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int
+mt7601u_chan_switch_read(struct seq_file *file, void *data)
+{
+	struct mt7601u_dev *dev = file->private;
+	int i;
+
+	seq_printf(file, "last:\t%uus\n", dev->chsw.last_us);
+	seq_printf(file, "max:\t%uus\n", dev->chsw.max_us);
+
+	for (i = 0; i < MT_CHSW_LAT_HIST - 1; i++)
+		seq_printf(file, "< %8uus:\t%u\n", 1 << i, dev->chsw.hist[i]);
+	seq_printf(file, ">=%8uus:\t%u\n", 1 << (i - 1), dev->chsw.hist[i]);
+
+	return 0;
+}
+
+static int
+mt7601u_chan_switch_open(struct inode *inode, struct file *f)
+{
+	return single_open(f, mt7601u_chan_switch_read, inode->i_private);
+}
+
+/* Any write resets the histogram */
+static ssize_t
+mt7601u_chan_switch_write(struct file *f, const char __user *buf,
+			  size_t count, loff_t *ppos)
+{
+	struct mt7601u_dev *dev = ((struct seq_file *)f->private_data)->private;
+
+	memset(&dev->chsw, 0, sizeof(dev->chsw));
+
+	return count;
+}
+
+static const struct file_operations fops_chan_switch = {
+	.open = mt7601u_chan_switch_open,
+	.read = seq_read,
+	.write = mt7601u_chan_switch_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int
+mt7601u_tx_queues_read(struct seq_file *file, void *data)
+{
+	struct mt7601u_dev *dev = file->private;
+	struct mt7601u_tx_queue_stats st;
+	u64 us, avg;
+	u32 used;
+	int i;
+
+	seq_puts(file, "ep\tsize\twake\tused\tmax\tavg\tstops\tstopped_us\t"
+		 "nospc\tnodev\tother\tlast_err\tlock_acq\tcontended\n");
+
+	for (i = 0; i < __MT_EP_OUT_MAX; i++) {
+		mt7601u_dma_tx_stats(dev, i, &st, &used);
+
+		us = max_t(s64, 1, ktime_us_delta(st.occ_last, st.since));
+		avg = div64_u64(st.occ_integral * 100, us);
+
+		seq_printf(file, "%d\t%u\t%u\t%u\t%u\t%llu.%02llu\t%u\t%llu"
+			   "\t\t%u\t%u\t%u\t%d\t\t%llu\t\t%llu\n",
+			   i, dev->tx_q[i].entries, dev->tx_q[i].wake_thresh,
+			   used, st.max_used,
+			   avg / 100, avg % 100, st.stops, st.stopped_us,
+			   st.err_nospc, st.err_nodev, st.err_other,
+			   st.last_err, st.lock_acq, st.lock_contended);
+	}
+
+	return 0;
+}
+
+static int
+mt7601u_tx_queues_open(struct inode *inode, struct file *f)
+{
+	return single_open(f, mt7601u_tx_queues_read, inode->i_private);
+}
+
+static const struct file_operations fops_tx_queues = {
+	.open = mt7601u_tx_queues_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int
+mt7601u_ampdu_tune_read(struct seq_file *file, void *data)
+{
+	struct mt7601u_dev *dev = file->private;
+	struct mt7601u_ampdu_tune *t = &dev->ampdu;
+
+	seq_printf(file, "mode:\t\t%s\n", t->manual ? "manual" : "auto");
+	seq_printf(file, "ba_size:\t%u\n", t->ba_size);
+	seq_printf(file, "density:\t%u\n", t->density);
+	seq_printf(file, "factor:\t\t%u\n", t->factor);
+	seq_printf(file, "retry:\t\t%u%%\n", t->retry_pct);
+	seq_printf(file, "avg_len:\t%u\n", t->avg_len);
+	seq_printf(file, "adjustments:\t%u\n", t->adjust);
+
+	return 0;
+}
+
+static int
+mt7601u_ampdu_tune_open(struct inode *inode, struct file *f)
+{
+	return single_open(f, mt7601u_ampdu_tune_read, inode->i_private);
+}
+
+static const struct file_operations fops_ampdu_tune = {
+	.open = mt7601u_ampdu_tune_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int
+mt7601u_regs_shadow_cmp(struct seq_file *file, struct mt7601u_dev *dev,
+			struct mt76_reg_pair *rp, int n)
+{
+	struct mt7601u_reg_shadow *sh = &dev->shadow;
+	int i, idx, ret, bad = 0;
+
+	ret = mt7601u_read_reg_pairs(dev, 0, rp, n);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < n; i++) {
+		idx = mt7601u_phy_shadow_idx(rp[i].reg);
+		/* Entry could have been dropped while we were reading */
+		if (idx < 0 || !test_bit(idx, sh->valid) ||
+		    sh->val[idx] == (u8)rp[i].value)
+			continue;
+
+		seq_printf(file, "%08x: shadow %02hhx hw %02hhx\n",
+			   rp[i].reg, sh->val[idx], (u8)rp[i].value);
+		bad++;
+	}
+
+	return bad;
+}
+
+/* Compare every cached BBP/RF value against the HW.  Values changing while
+ * the check runs will show up as mismatches, quiesce the device first.
+ */
+static int
+mt7601u_regs_shadow_read(struct seq_file *file, void *data)
+{
+	struct mt7601u_dev *dev = file->private;
+	struct mt7601u_reg_shadow *sh = &dev->shadow;
+	struct mt76_reg_pair rp[16];
+	int bit, n = 0, cached = 0, bad = 0, ret = 0;
+
+	seq_printf(file, "hits:\t\t%u\n", sh->hits);
+	seq_printf(file, "misses:\t\t%u\n", sh->misses);
+
+	if (!test_bit(MT7601U_STATE_WLAN_RUNNING, &dev->state) ||
+	    !test_bit(MT7601U_STATE_MCU_RUNNING, &dev->state))
+		return 0;
+
+	for_each_set_bit(bit, sh->valid, MT_SHADOW_SIZE) {
+		rp[n++].reg = mt7601u_phy_shadow_addr(bit);
+		cached++;
+		if (n < ARRAY_SIZE(rp))
+			continue;
+
+		ret = mt7601u_regs_shadow_cmp(file, dev, rp, n);
+		if (ret < 0)
+			break;
+		bad += ret;
+		n = 0;
+	}
+	if (n && ret >= 0) {
+		ret = mt7601u_regs_shadow_cmp(file, dev, rp, n);
+		if (ret > 0)
+			bad += ret;
+	}
+	if (ret < 0) {
+		seq_printf(file, "check failed:\t%d\n", ret);
+		return 0;
+	}
+
+	seq_printf(file, "cached:\t\t%d\n", cached);
+	seq_printf(file, "mismatched:\t%d\n", bad);
+
+	return 0;
+}
+
+static int
+mt7601u_regs_shadow_open(struct inode *inode, struct file *f)
+{
+	return single_open(f, mt7601u_regs_shadow_read, inode->i_private);
+}
+
+static const struct file_operations fops_regs_shadow = {
+	.open = mt7601u_regs_shadow_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int
+mt7601u_calibration_read(struct seq_file *file, void *data)
+{
+	struct mt7601u_dev *dev = file->private;
+	struct mt7601u_cal_state *cal = &dev->cal;
+
+	seq_printf(file, "interval:\t%ums\n", jiffies_to_msecs(cal->interval));
+	seq_printf(file, "runs:\t\t%u\n", cal->runs);
+	seq_printf(file, "skipped agc:\t%u\n", cal->skip_agc);
+	seq_printf(file, "skipped tssi:\t%u\n", cal->skip_tssi);
+	seq_printf(file, "skipped temp:\t%u\n", cal->skip_temp);
+	seq_printf(file, "usb xfers:\t%u last, %llu total\n",
+		   cal->usb_xfers, cal->usb_xfers_total);
+	seq_printf(file, "time:\t\t%uus last, %uus max, %lluus total\n",
+		   cal->time_us, cal->time_max_us, cal->time_total_us);
+
+	return 0;
+}
+
+static int
+mt7601u_calibration_open(struct inode *inode, struct file *f)
+{
+	return single_open(f, mt7601u_calibration_read, inode->i_private);
+}
+
+static const struct file_operations fops_calibration = {
+	.open = mt7601u_calibration_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int
+mt7601u_freq_cal_read(struct seq_file *file, void *data)
+{
+	struct mt7601u_dev *dev = file->private;
+	struct mt7601u_freq_cal *fc = &dev->freq_cal;
+
+	seq_printf(file, "enabled:\t%d\n", fc->enabled);
+	seq_printf(file, "adjusting:\t%d\n", fc->adjusting);
+	seq_printf(file, "freq:\t\t%02hhx\n", fc->freq);
+	seq_printf(file, "phy_mode:\t%hhu\n", fc->phy_mode);
+	seq_printf(file, "avg_off:\t%d\n", fc->avg / 16);
+	seq_printf(file, "beacons:\t%u\n", fc->beacons);
+	seq_printf(file, "steps:\t\t%u\n", fc->steps);
+
+	return 0;
+}
+
+static int
+mt7601u_freq_cal_open(struct inode *inode, struct file *f)
+{
+	return single_open(f, mt7601u_freq_cal_read, inode->i_private);
+}
+
+static const struct file_operations fops_freq_cal = {
+	.open = mt7601u_freq_cal_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int
+mt7601u_cal_cache_read(struct seq_file *file, void *data)
+{
+	struct mt7601u_dev *dev = file->private;
+	struct mt7601u_cal_cache *cc = &dev->cal_cache;
+	int i;
+
+	seq_printf(file, "enabled:\t%u\n", cc->enabled);
+	seq_printf(file, "addr:\t\t%pM\n", cc->addr);
+	seq_printf(file, "hits:\t\t%u\n", cc->hits);
+	seq_printf(file, "misses:\t\t%u\n", cc->misses);
+	seq_printf(file, "full_us:\t%u\n", cc->full_us);
+	seq_printf(file, "replay_us:\t%u\n", cc->replay_us);
+
+	for (i = 0; i < MT_CAL_CACHE_SLOTS; i++) {
+		struct mt7601u_cal_cache_entry *ent = &cc->ent[i];
+
+		if (!ent->valid)
+			continue;
+		seq_printf(file, "band %d: tssi:%hhx/%hhx db:%hd/%hd\n",
+			   ent->temp_band, ent->tssi_init, ent->tssi_init_hvga,
+			   ent->tssi_db, ent->tssi_hvga_db);
+	}
+
+	return 0;
+}
+
+static int
+mt7601u_cal_cache_open(struct inode *inode, struct file *f)
+{
+	return single_open(f, mt7601u_cal_cache_read, inode->i_private);
+}
+
+/* Any write drops the cached results, next init calibrates in full */
+static ssize_t
+mt7601u_cal_cache_write(struct file *f, const char __user *buf,
+			size_t count, loff_t *ppos)
+{
+	struct mt7601u_dev *dev = ((struct seq_file *)f->private_data)->private;
+
+	mutex_lock(&dev->mutex);
+	memset(dev->cal_cache.ent, 0, sizeof(dev->cal_cache.ent));
+	mutex_unlock(&dev->mutex);
+
+	return count;
+}
+
+static const struct file_operations fops_cal_cache = {
+	.open = mt7601u_cal_cache_open,
+	.read = seq_read,
+	.write = mt7601u_cal_cache_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int
+mt7601u_prot_policy_read(struct seq_file *file, void *data)
+{
+	static const char * const level_name[] = {
+		[MT_PROT_LVL_BSS] = "bss",
+		[MT_PROT_LVL_CTS2SELF] = "cts2self",
+		[MT_PROT_LVL_RTS_CTS] = "rts/cts",
+	};
+	struct mt7601u_dev *dev = file->private;
+	struct mt7601u_prot_policy *p = &dev->prot;
+
+	seq_printf(file, "mode:\t\t%s\n", p->auto_en ? "auto" : "bss");
+	seq_printf(file, "level:\t\t%s\n", level_name[p->level]);
+	seq_printf(file, "ht_mode:\t%04x\n", p->ht_mode);
+	seq_printf(file, "legacy_prot:\t%d\n", p->legacy_prot);
+	seq_printf(file, "retry:\t\t%u%%\n", p->retry_pct);
+	seq_printf(file, "fail:\t\t%u%%\n", p->fail_pct);
+	seq_printf(file, "changes:\t%u\n", p->changes);
+
+	return 0;
+}
+
+static int
+mt7601u_prot_policy_open(struct inode *inode, struct file *f)
+{
+	return single_open(f, mt7601u_prot_policy_read, inode->i_private);
+}
+
+static const struct file_operations fops_prot_policy = {
+	.open = mt7601u_prot_policy_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int
+mt7601u_tx_burst_read(struct seq_file *file, void *data)
+{
+	static const char * const mode_name[] = {
+		[MT_TX_BURST_OFF] = "off",
+		[MT_TX_BURST_ON] = "on",
+		[MT_TX_BURST_AUTO] = "auto",
+	};
+	struct mt7601u_dev *dev = file->private;
+	struct mt7601u_tx_burst *b = &dev->burst;
+	u32 mode = min_t(u32, b->mode, MT_TX_BURST_AUTO);
+
+	seq_printf(file, "mode:\t\t%s\n", mode_name[mode]);
+	seq_printf(file, "hw_q:\t\t%d\n", b->hw_q);
+	seq_printf(file, "load on:\t%u kbit/s queued\n", b->load_on);
+	seq_printf(file, "load off:\t%u kbit/s queued\n", b->load_off);
+	seq_printf(file, "switches:\t%u\n", b->switches);
+
+	return 0;
+}
+
+static int
+mt7601u_tx_burst_open(struct inode *inode, struct file *f)
+{
+	return single_open(f, mt7601u_tx_burst_read, inode->i_private);
+}
+
+static const struct file_operations fops_tx_burst = {
+	.open = mt7601u_tx_burst_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 static int
 mt7601u_eeprom_param_read(struct seq_file *file, void *data)
 {
@@ -169,4 +756,66 @@ void mt7601u_init_debugfs(struct mt7601u_dev *dev)
 	debugfs_create_file("ampdu_stat", S_IRUSR, dir, dev, &fops_ampdu_stat);
 	debugfs_create_file("eeprom_param", S_IRUSR, dir, dev,
 			    &fops_eeprom_param);
+	debugfs_create_file("tx_batch", S_IRUSR, dir, dev, &fops_tx_batch);
+	debugfs_create_atomic_t("tx_slow_headroom", S_IRUSR, dir,
+				&dev->tx_slow_path.headroom);
+	debugfs_create_atomic_t("tx_slow_cloned", S_IRUSR, dir,
+				&dev->tx_slow_path.cloned);
+	debugfs_create_atomic_t("tx_slow_tailroom", S_IRUSR, dir,
+				&dev->tx_slow_path.tailroom);
+	debugfs_create_atomic_t("tx_csum_hw", S_IRUSR, dir, &dev->tx_csum.hw);
+	debugfs_create_atomic_t("tx_csum_sw", S_IRUSR, dir, &dev->tx_csum.sw);
+	debugfs_create_atomic_t("rx_csum_hw", S_IRUSR, dir,
+				&dev->rx_csum_stats.hw);
+	debugfs_create_atomic_t("rx_csum_sw", S_IRUSR, dir,
+				&dev->rx_csum_stats.sw);
+	debugfs_create_atomic_t("rx_csum_err", S_IRUSR, dir,
+				&dev->rx_csum_stats.err);
+	debugfs_create_file("rx_cost", S_IRUSR | S_IWUSR, dir, dev,
+			    &fops_rx_cost);
+	debugfs_create_u32("rx_cost_en", S_IRUSR | S_IWUSR, dir,
+			   &dev->rx_cost.enabled);
+	debugfs_create_file("tx_flush", S_IRUSR, dir, dev, &fops_tx_flush);
+	debugfs_create_file("tx_status", S_IRUSR, dir, dev, &fops_tx_status);
+	debugfs_create_file("tx_latency", S_IRUSR | S_IWUSR, dir, dev,
+			    &fops_tx_lat);
+	debugfs_create_file("tx_queues", S_IRUSR, dir, dev, &fops_tx_queues);
+	debugfs_create_u32("tx_ring_vo", S_IRUSR | S_IWUSR, dir,
+			   &dev->tx_ring_size[IEEE80211_AC_VO]);
+	debugfs_create_u32("tx_ring_vi", S_IRUSR | S_IWUSR, dir,
+			   &dev->tx_ring_size[IEEE80211_AC_VI]);
+	debugfs_create_u32("tx_ring_be", S_IRUSR | S_IWUSR, dir,
+			   &dev->tx_ring_size[IEEE80211_AC_BE]);
+	debugfs_create_u32("tx_ring_bk", S_IRUSR | S_IWUSR, dir,
+			   &dev->tx_ring_size[IEEE80211_AC_BK]);
+	debugfs_create_u32("tx_wake_div", S_IRUSR | S_IWUSR, dir,
+			   &dev->tx_wake_div);
+	debugfs_create_file("ampdu_tune", S_IRUSR, dir, dev, &fops_ampdu_tune);
+	debugfs_create_file("tx_burst", S_IRUSR, dir, dev, &fops_tx_burst);
+	debugfs_create_file("prot_policy", S_IRUSR, dir, dev,
+			    &fops_prot_policy);
+	debugfs_create_file("calibration", S_IRUSR, dir, dev,
+			    &fops_calibration);
+	debugfs_create_file("freq_cal", S_IRUSR, dir, dev, &fops_freq_cal);
+	debugfs_create_file("cal_cache", S_IRUSR | S_IWUSR, dir, dev,
+			    &fops_cal_cache);
+	debugfs_create_u32("cal_cache_en", S_IRUSR | S_IWUSR, dir,
+			   &dev->cal_cache.enabled);
+	debugfs_create_file("regs_shadow", S_IRUSR, dir, dev,
+			    &fops_regs_shadow);
+	debugfs_create_file("chan_switch", S_IRUSR | S_IWUSR, dir, dev,
+			    &fops_chan_switch);
+	debugfs_create_u32("prot_auto", S_IRUSR | S_IWUSR, dir,
+			   &dev->prot.auto_en);
+	debugfs_create_u32("tx_burst_mode", S_IRUSR | S_IWUSR, dir,
+			   &dev->burst.mode);
+	debugfs_create_u32("ampdu_manual", S_IRUSR | S_IWUSR, dir,
+			   &dev->ampdu.manual);
+	debugfs_create_u32("ampdu_ba_size", S_IRUSR | S_IWUSR, dir,
+			   &dev->ampdu.ba_size);
+	debugfs_create_u32("ampdu_density", S_IRUSR | S_IWUSR, dir,
+			   &dev->ampdu.density);
+
+	mt7601u_pktgen_init_debugfs(dev, dir);
+	mt7601u_scan_init_debugfs(dev, dir);
 }
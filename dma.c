@@ -32,6 +32,28 @@ static unsigned int ieee80211_get_hdrlen_from_buf(const u8 *data, unsigned len)
 	return hdrlen;
 }
 
+static u32
+mt7601u_rx_process_rxwi(struct mt7601u_dev *dev, struct sk_buff *skb,
+			void *data, struct mt7601u_rxwi *rxwi)
+{
+	struct mt7601u_rx_cost *cost = &dev->rx_cost;
+	u64 start;
+	u32 len, ns;
+
+	if (likely(!cost->enabled))
+		return mt76_mac_process_rx(dev, skb, data, rxwi);
+
+	start = ktime_to_ns(ktime_get());
+	len = mt76_mac_process_rx(dev, skb, data, rxwi);
+	ns = ktime_to_ns(ktime_get()) - start;
+
+	cost->frames++;
+	cost->time_ns += ns;
+	cost->max_ns = max(cost->max_ns, ns);
+
+	return len;
+}
+
 static struct sk_buff *
 mt7601u_rx_skb_from_seg(struct mt7601u_dev *dev, struct mt7601u_rxwi *rxwi,
 			void *data, u32 seg_len, u32 truesize, struct page *p)
@@ -43,7 +65,7 @@ mt7601u_rx_skb_from_seg(struct mt7601u_dev *dev, struct mt7601u_rxwi *rxwi,
 	if (!skb)
 		return NULL;
 
-	true_len = mt76_mac_process_rx(dev, skb, data, rxwi);
+	true_len = mt7601u_rx_process_rxwi(dev, skb, data, rxwi);
 	if (!true_len || true_len > seg_len)
 		goto bad_frame;
 
@@ -81,6 +103,40 @@ bad_frame:
 	return NULL;
 }
 
+/* Trust HW L3/L4 checksum verification only for plain data frames which
+ * either weren't protected or were decrypted by the HW, otherwise the FCE
+ * could not have seen the real payload.
+ */
+static void mt7601u_rx_csum(struct mt7601u_dev *dev, struct sk_buff *skb,
+			    struct mt7601u_rxwi *rxwi, u32 fce_info)
+{
+	u32 rxinfo = le32_to_cpu(rxwi->rxinfo);
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)skb->data;
+
+	if (!dev->rx_csum || !(rxinfo & MT_RXINFO_DATA))
+		return;
+
+	if (!(fce_info & MT_RXD_PKT_INFO_L3L4_DONE) ||
+	    rxinfo & (MT_RXINFO_AMSDU | MT_RXINFO_FRAG |
+		      MT_RXINFO_IP_SUM_BYPASS | MT_RXINFO_TCP_SUM_BYPASS) ||
+	    (ieee80211_has_protected(hdr->frame_control) &&
+	     !(rxinfo & MT_RXINFO_DECRYPT))) {
+		atomic_inc(&dev->rx_csum_stats.sw);
+		return;
+	}
+
+	/* Leave verification of bad frames to the stack */
+	if (fce_info & (MT_RXD_PKT_INFO_IP_ERR | MT_RXD_PKT_INFO_TCP_ERR |
+			MT_RXD_PKT_INFO_UDP_ERR) ||
+	    rxinfo & (MT_RXINFO_IP_SUM_ERR | MT_RXINFO_TCP_SUM_ERR)) {
+		atomic_inc(&dev->rx_csum_stats.err);
+		return;
+	}
+
+	skb->ip_summed = CHECKSUM_UNNECESSARY;
+	atomic_inc(&dev->rx_csum_stats.hw);
+}
+
 static void mt7601u_rx_process_seg(struct mt7601u_dev *dev, u8 *data,
 				   u32 seg_len, struct page *p)
 {
@@ -112,6 +168,8 @@ static void mt7601u_rx_process_seg(struct mt7601u_dev *dev, u8 *data,
 	if (!skb)
 		return;
 
+	mt7601u_rx_csum(dev, skb, rxwi, fce_info);
+
 	spin_lock(&dev->mac_lock);
 	ieee80211_rx(dev->hw, skb);
 	spin_unlock(&dev->mac_lock);
@@ -221,6 +279,58 @@ static void mt7601u_rx_tasklet(unsigned long data)
 	}
 }
 
+/* Must be called with q->lock held before q->used changes. */
+static void mt7601u_tx_queue_occ_update(struct mt7601u_tx_queue *q)
+{
+	ktime_t now = ktime_get();
+
+	q->stats.occ_integral += (u64)q->used *
+				 ktime_us_delta(now, q->stats.occ_last);
+	q->stats.occ_last = now;
+}
+
+static void mt7601u_tx_queue_stop(struct mt7601u_tx_queue *q,
+				  struct sk_buff *skb)
+{
+	struct mt7601u_dev *dev = q->dev;
+
+	ieee80211_stop_queue(dev->hw, skb_get_queue_mapping(skb));
+
+	if (q->stopped)
+		return;
+	q->stopped = true;
+	q->stats.stops++;
+	q->stats.stop_time = ktime_get();
+	trace_mt_tx_queue_state(dev, q - dev->tx_q, q->used, true);
+}
+
+static void mt7601u_tx_queue_wake(struct mt7601u_tx_queue *q,
+				  struct sk_buff *skb)
+{
+	struct mt7601u_dev *dev = q->dev;
+
+	ieee80211_wake_queue(dev->hw, skb_get_queue_mapping(skb));
+
+	if (!q->stopped)
+		return;
+	q->stopped = false;
+	q->stats.stopped_us += ktime_us_delta(ktime_get(), q->stats.stop_time);
+	trace_mt_tx_queue_state(dev, q - dev->tx_q, q->used, false);
+}
+
+/* Take the ring lock on the submission/completion paths, counting how
+ * often the other side held it.
+ */
+static void mt7601u_tx_queue_lock(struct mt7601u_tx_queue *q,
+				  unsigned long *flags)
+{
+	if (!spin_trylock_irqsave(&q->lock, *flags)) {
+		spin_lock_irqsave(&q->lock, *flags);
+		q->stats.lock_contended++;
+	}
+	q->stats.lock_acq++;
+}
+
 static void mt7601u_complete_tx(struct urb *urb)
 {
 	struct mt7601u_tx_queue *q = urb->context;
@@ -228,7 +338,7 @@ static void mt7601u_complete_tx(struct urb *urb)
 	struct sk_buff *skb;
 	unsigned long flags;
 
-	spin_lock_irqsave(&dev->tx_lock, flags);
+	mt7601u_tx_queue_lock(q, &flags);
 
 	if (mt7601u_urb_has_error(urb))
 		dev_err(dev->dev, "Error: TX urb failed:%d\n", urb->status);
@@ -238,16 +348,21 @@ static void mt7601u_complete_tx(struct urb *urb)
 	skb = q->e[q->start].skb;
 	trace_mt_tx_dma_done(dev, skb);
 
-	__skb_queue_tail(&dev->tx_skb_done, skb);
-	tasklet_schedule(&dev->tx_tasklet);
+	if (urb->status)
+		mt7601u_tx_skb_cb(skb)->flags |= MT_TX_CB_DMA_FAIL;
+	mt7601u_tx_lat_update(dev, skb, MT_TX_LAT_USB);
 
-	if (q->used == q->entries - q->entries / 8)
-		ieee80211_wake_queue(dev->hw, skb_get_queue_mapping(skb));
+	skb_queue_tail(&dev->tx_skb_done, skb);
+	tasklet_schedule(&dev->tx_tasklet);
 
+	mt7601u_tx_queue_occ_update(q);
 	q->start = (q->start + 1) % q->entries;
 	q->used--;
+
+	if (q->stopped && q->used <= q->wake_thresh)
+		mt7601u_tx_queue_wake(q, skb);
 out:
-	spin_unlock_irqrestore(&dev->tx_lock, flags);
+	spin_unlock_irqrestore(&q->lock, flags);
 }
 
 static void mt7601u_tx_tasklet(unsigned long data)
@@ -255,25 +370,32 @@ static void mt7601u_tx_tasklet(unsigned long data)
 	struct mt7601u_dev *dev = (struct mt7601u_dev *) data;
 	struct sk_buff_head skbs;
 	unsigned long flags;
+	u32 n;
 
 	__skb_queue_head_init(&skbs);
 
-	spin_lock_irqsave(&dev->tx_lock, flags);
-
+	/* Pairs with the re-check in mt7601u_tx_stat(), see there. */
 	set_bit(MT7601U_STATE_MORE_STATS, &dev->state);
 	if (!test_and_set_bit(MT7601U_STATE_READING_STATS, &dev->state))
 		queue_delayed_work(dev->stat_wq, &dev->stat_work,
 				   msecs_to_jiffies(10));
 
+	spin_lock_irqsave(&dev->tx_skb_done.lock, flags);
 	skb_queue_splice_init(&dev->tx_skb_done, &skbs);
+	spin_unlock_irqrestore(&dev->tx_skb_done.lock, flags);
 
-	spin_unlock_irqrestore(&dev->tx_lock, flags);
+	n = skb_queue_len(&skbs);
+	if (!n)
+		return;
 
-	while (!skb_queue_empty(&skbs)) {
-		struct sk_buff *skb = __skb_dequeue(&skbs);
+	dev->tx_batch.hist[min_t(int, fls(n) - 1, MT_TX_BATCH_HIST - 1)]++;
+	dev->tx_batch.max = max(dev->tx_batch.max, n);
+	dev->tx_batch.batches++;
+	dev->tx_batch.skbs += n;
 
-		mt7601u_tx_status(dev, skb);
-	}
+	mt7601u_tx_status(dev, &skbs);
+
+	wake_up(&dev->tx_flush_wq);
 }
 
 static int mt7601u_dma_submit_tx(struct mt7601u_dev *dev,
@@ -286,37 +408,50 @@ static int mt7601u_dma_submit_tx(struct mt7601u_dev *dev,
 	unsigned long flags;
 	int ret;
 
-	spin_lock_irqsave(&dev->tx_lock, flags);
+	mt7601u_tx_queue_lock(q, &flags);
 
 	if (WARN_ON(q->entries <= q->used)) {
 		ret = -ENOSPC;
+		q->stats.err_nospc++;
+		q->stats.last_err = ret;
 		goto out;
 	}
 
 	e = &q->e[q->end];
 	e->skb = skb;
+	mt7601u_tx_lat_update(dev, skb, MT_TX_LAT_QUEUE);
 	usb_fill_bulk_urb(e->urb, usb_dev, snd_pipe, skb->data, skb->len,
 			  mt7601u_complete_tx, q);
-	ret = usb_submit_urb(e->urb, GFP_ATOMIC);
+	if (mt7601u_tx_skb_cb(skb)->flags & MT_TX_CB_PKTGEN &&
+	    test_bit(MT7601U_STATE_MOCK_URB, &dev->state))
+		ret = mt7601u_pktgen_mock_submit(dev, e->urb);
+	else
+		ret = usb_submit_urb(e->urb, GFP_ATOMIC);
 	if (ret) {
 		/* Special-handle ENODEV from TX urb submission because it will
 		 * often be the first ENODEV we see after device is removed.
 		 */
-		if (ret == -ENODEV)
+		if (ret == -ENODEV) {
 			set_bit(MT7601U_STATE_REMOVED, &dev->state);
-		else
+			q->stats.err_nodev++;
+		} else {
 			dev_err(dev->dev, "Error: TX urb submit failed:%d\n",
 				ret);
+			q->stats.err_other++;
+		}
+		q->stats.last_err = ret;
 		goto out;
 	}
 
+	mt7601u_tx_queue_occ_update(q);
 	q->end = (q->end + 1) % q->entries;
 	q->used++;
+	q->stats.max_used = max(q->stats.max_used, q->used);
 
 	if (q->used >= q->entries)
-		ieee80211_stop_queue(dev->hw, skb_get_queue_mapping(skb));
+		mt7601u_tx_queue_stop(q, skb);
 out:
-	spin_unlock_irqrestore(&dev->tx_lock, flags);
+	spin_unlock_irqrestore(&q->lock, flags);
 
 	return ret;
 }
@@ -339,13 +474,30 @@ static enum mt76_qsel ep2dmaq(u8 ep)
 int mt7601u_dma_enqueue_tx(struct mt7601u_dev *dev, struct sk_buff *skb,
 			   struct mt76_wcid *wcid, int hw_q)
 {
+	bool pktgen = mt7601u_tx_skb_cb(skb)->flags & MT_TX_CB_PKTGEN;
 	u8 ep = q2ep(hw_q);
 	u32 dma_flags;
 	int ret;
 
+	/* Mock completions look like ACKs, don't let them reach mac80211 */
+	if (!pktgen && test_bit(MT7601U_STATE_MOCK_URB, &dev->state)) {
+		atomic_inc(&dev->pktgen.mock_drops);
+		ieee80211_free_txskb(dev->hw, skb);
+		return -EBUSY;
+	}
+
 	dma_flags = MT_TXD_PKT_INFO_80211;
 	if (wcid->hw_key_idx == 0xff)
 		dma_flags |= MT_TXD_PKT_INFO_WIV;
+	if (mt7601u_tx_skb_cb(skb)->flags & MT_TX_CB_HW_CSUM)
+		dma_flags |= MT_TXD_PKT_INFO_CSO;
+	if (hw_q == READ_ONCE(dev->burst.hw_q) &&
+	    READ_ONCE(dev->burst.mode) != MT_TX_BURST_OFF)
+		dma_flags |= MT_TXD_PKT_INFO_TX_BURST;
+
+	/* Padding to 4B plus the 4B zero trailer, see mt7601u_dma_skb_wrap() */
+	if (skb_tailroom(skb) < round_up(skb->len, 4) - skb->len + 4)
+		atomic_inc(&dev->tx_slow_path.tailroom);
 
 	ret = mt7601u_dma_skb_wrap_pkt(skb, ep2dmaq(ep), dma_flags);
 	if (ret)
@@ -353,13 +505,114 @@ int mt7601u_dma_enqueue_tx(struct mt7601u_dev *dev, struct sk_buff *skb,
 
 	ret = mt7601u_dma_submit_tx(dev, skb, ep);
 	if (ret) {
-		ieee80211_free_txskb(dev->hw, skb);
+		if (pktgen)
+			dev_kfree_skb(skb);
+		else
+			ieee80211_free_txskb(dev->hw, skb);
 		return ret;
 	}
 
 	return 0;
 }
 
+u32 mt7601u_dma_tx_used(struct mt7601u_dev *dev, int hw_q, u32 *entries)
+{
+	struct mt7601u_tx_queue *q = &dev->tx_q[q2ep(hw_q)];
+	unsigned long flags;
+	u32 used;
+
+	spin_lock_irqsave(&q->lock, flags);
+	used = q->used;
+	*entries = q->entries;
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	return used;
+}
+
+/* Snapshot of ring statistics with the time since the last event folded in,
+ * so that the caller sees up-to-date occupancy integral and stopped time.
+ */
+void mt7601u_dma_tx_stats(struct mt7601u_dev *dev, int ep,
+			  struct mt7601u_tx_queue_stats *st, u32 *used)
+{
+	struct mt7601u_tx_queue *q = &dev->tx_q[ep];
+	unsigned long flags;
+
+	spin_lock_irqsave(&q->lock, flags);
+	mt7601u_tx_queue_occ_update(q);
+	*st = q->stats;
+	*used = q->used;
+	if (q->stopped)
+		st->stopped_us += ktime_us_delta(ktime_get(), st->stop_time);
+	spin_unlock_irqrestore(&q->lock, flags);
+}
+
+static bool mt7601u_tx_queue_idle(struct mt7601u_tx_queue *q)
+{
+	unsigned long flags;
+	bool idle;
+
+	spin_lock_irqsave(&q->lock, flags);
+	idle = !q->used;
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	return idle;
+}
+
+static bool mt7601u_dma_tx_idle(struct mt7601u_dev *dev, u32 eps)
+{
+	int i;
+
+	for (i = 0; i < __MT_EP_OUT_MAX; i++)
+		if (eps & BIT(i) && !mt7601u_tx_queue_idle(&dev->tx_q[i]))
+			return false;
+
+	return skb_queue_empty(&dev->tx_skb_done);
+}
+
+/* Kill in-flight URBs one by one starting from the oldest so that
+ * completions keep arriving in ring order.  Killed frames are reported to
+ * mac80211 as not acknowledged.
+ */
+static void mt7601u_kill_tx_queue(struct mt7601u_tx_queue *q)
+{
+	unsigned long flags;
+	struct urb *urb;
+	int i;
+
+	for (i = 0; i < q->entries; i++) {
+		spin_lock_irqsave(&q->lock, flags);
+		urb = q->used ? q->e[q->start].urb : NULL;
+		spin_unlock_irqrestore(&q->lock, flags);
+
+		if (!urb)
+			break;
+		usb_kill_urb(urb);
+	}
+}
+
+int mt7601u_dma_flush_tx(struct mt7601u_dev *dev, u32 hw_qs, bool drop,
+			 unsigned long timeout)
+{
+	u32 eps = 0;
+	int i;
+
+	for (i = 0; i < __MT_EP_OUT_MAX; i++)
+		if (hw_qs & BIT(i))
+			eps |= BIT(q2ep(i));
+
+	if (drop)
+		for (i = 0; i < __MT_EP_OUT_MAX; i++)
+			if (eps & BIT(i))
+				mt7601u_kill_tx_queue(&dev->tx_q[i]);
+
+	if (!wait_event_timeout(dev->tx_flush_wq,
+				mt7601u_dma_tx_idle(dev, eps), timeout))
+		return -ETIMEDOUT;
+
+	return 0;
+}
+
 static void mt7601u_kill_rx(struct mt7601u_dev *dev)
 {
 	int i;
@@ -451,6 +704,10 @@ static void mt7601u_free_tx_queue(struct mt7601u_tx_queue *q)
 		usb_poison_urb(q->e[i].urb);
 		usb_free_urb(q->e[i].urb);
 	}
+
+	kfree(q->e);
+	q->e = NULL;
+	q->entries = 0;
 }
 
 static void mt7601u_free_tx(struct mt7601u_dev *dev)
@@ -461,20 +718,79 @@ static void mt7601u_free_tx(struct mt7601u_dev *dev)
 		mt7601u_free_tx_queue(&dev->tx_q[i]);
 }
 
-static int mt7601u_alloc_tx_queue(struct mt7601u_dev *dev,
-				  struct mt7601u_tx_queue *q)
+/* Ring size of USB endpoint @ep, endpoints not used for data get none. */
+static unsigned int mt7601u_tx_ring_size(struct mt7601u_dev *dev, u8 ep)
 {
+	int ac;
+
+	for (ac = 0; ac < IEEE80211_NUM_ACS; ac++)
+		if (q2ep(q2hwq(ac)) == ep)
+			return clamp_t(u32, dev->tx_ring_size[ac],
+				       MT_TX_RING_MIN, MT_TX_RING_MAX);
+
+	return 0;
+}
+
+static void mt7601u_tx_queue_set_wake(struct mt7601u_dev *dev,
+				      struct mt7601u_tx_queue *q)
+{
+	u32 div = clamp_t(u32, dev->tx_wake_div, 1, max(q->entries, 1U));
+
+	q->wake_thresh = q->entries - q->entries / div;
+}
+
+static struct mt7601u_dma_buf_tx *
+mt7601u_alloc_tx_entries(unsigned int entries)
+{
+	struct mt7601u_dma_buf_tx *e;
 	int i;
 
-	q->dev = dev;
-	q->entries = N_TX_ENTRIES;
+	e = kcalloc(entries, sizeof(*e), GFP_KERNEL);
+	if (!e)
+		return NULL;
 
-	for (i = 0; i < N_TX_ENTRIES; i++) {
-		q->e[i].urb = usb_alloc_urb(0, GFP_KERNEL);
-		if (!q->e[i].urb)
-			return -ENOMEM;
+	for (i = 0; i < entries; i++) {
+		e[i].urb = usb_alloc_urb(0, GFP_KERNEL);
+		if (!e[i].urb)
+			goto err;
 	}
 
+	return e;
+err:
+	while (i--)
+		usb_free_urb(e[i].urb);
+	kfree(e);
+	return NULL;
+}
+
+static void mt7601u_init_tx_queue(struct mt7601u_dev *dev,
+				  struct mt7601u_tx_queue *q,
+				  struct mt7601u_dma_buf_tx *e,
+				  unsigned int entries)
+{
+	memset(q, 0, sizeof(*q));
+	q->dev = dev;
+	spin_lock_init(&q->lock);
+	q->stats.since = ktime_get();
+	q->stats.occ_last = q->stats.since;
+
+	q->e = e;
+	q->entries = entries;
+	mt7601u_tx_queue_set_wake(dev, q);
+}
+
+static int mt7601u_alloc_tx_queue(struct mt7601u_dev *dev,
+				  struct mt7601u_tx_queue *q, u8 ep)
+{
+	unsigned int entries = mt7601u_tx_ring_size(dev, ep);
+	struct mt7601u_dma_buf_tx *e;
+
+	e = mt7601u_alloc_tx_entries(entries);
+	if (!e)
+		return -ENOMEM;
+
+	mt7601u_init_tx_queue(dev, q, e, entries);
+
 	return 0;
 }
 
@@ -486,12 +802,51 @@ static int mt7601u_alloc_tx(struct mt7601u_dev *dev)
 				 sizeof(*dev->tx_q), GFP_KERNEL);
 
 	for (i = 0; i < __MT_EP_OUT_MAX; i++)
-		if (mt7601u_alloc_tx_queue(dev, &dev->tx_q[i]))
+		if (mt7601u_alloc_tx_queue(dev, &dev->tx_q[i], i))
 			return -ENOMEM;
 
 	return 0;
 }
 
+/* Apply ring sizes and wake thresholds configured while the interface was
+ * down.  Rings which change size have to be idle.  New rings are allocated
+ * before the old ones are freed, if that fails the old ring is kept.
+ */
+int mt7601u_dma_resize_tx(struct mt7601u_dev *dev)
+{
+	struct mt7601u_dma_buf_tx *e;
+	struct mt7601u_tx_queue *q;
+	unsigned int entries;
+	int i;
+
+	for (i = 0; i < __MT_EP_OUT_MAX; i++) {
+		q = &dev->tx_q[i];
+
+		entries = mt7601u_tx_ring_size(dev, i);
+		if (q->entries == entries) {
+			mt7601u_tx_queue_set_wake(dev, q);
+			continue;
+		}
+
+		mt7601u_pktgen_stop(dev);
+		if (!mt7601u_tx_queue_idle(q))
+			return -EBUSY;
+
+		e = mt7601u_alloc_tx_entries(entries);
+		if (!e) {
+			dev_err(dev->dev, "Error: TX ring %d resize failed, keeping %u entries\n",
+				i, q->entries);
+			mt7601u_tx_queue_set_wake(dev, q);
+			continue;
+		}
+
+		mt7601u_free_tx_queue(q);
+		mt7601u_init_tx_queue(dev, q, e, entries);
+	}
+
+	return 0;
+}
+
 int mt7601u_dma_init(struct mt7601u_dev *dev)
 {
 	int ret = -ENOMEM;
@@ -22,6 +22,31 @@
 
 #include "initvals.h"
 
+static bool tx_csum;
+module_param(tx_csum, bool, S_IRUGO);
+MODULE_PARM_DESC(tx_csum, "Offload TCP/UDP checksum calculation on TX");
+
+static unsigned int tx_ring_size[IEEE80211_NUM_ACS] = {
+	[0 ... IEEE80211_NUM_ACS - 1] = N_TX_ENTRIES,
+};
+module_param_array(tx_ring_size, uint, NULL, S_IRUGO);
+MODULE_PARM_DESC(tx_ring_size, "TX ring sizes for VO,VI,BE,BK (8-256)");
+
+static unsigned int tx_wake_div = 8;
+module_param(tx_wake_div, uint, S_IRUGO);
+MODULE_PARM_DESC(tx_wake_div,
+		 "Wake a stopped TX queue once 1/N of its ring is free "
+		 "(1 waits for an empty ring)");
+
+static unsigned int tx_burst = MT_TX_BURST_OFF;
+module_param(tx_burst, uint, S_IRUGO);
+MODULE_PARM_DESC(tx_burst,
+		 "TX burst: 0 off (long TXOP on HW Q0 only), 1 on, 2 auto");
+
+static bool rx_csum;
+module_param(rx_csum, bool, S_IRUGO);
+MODULE_PARM_DESC(rx_csum, "Trust HW TCP/UDP checksum verification on RX");
+
 static void
 mt7601u_set_wlan_state(struct mt7601u_dev *dev, u32 val, bool enable)
 {
@@ -335,6 +360,7 @@ int mt7601u_init_hardware(struct mt7601u_dev *dev)
 	int ret;
 
 	dev->beacon_offsets = beacon_offsets;
+	mt7601u_phy_shadow_reset(dev);
 
 	mt7601u_chip_onoff(dev, true, false);
 
@@ -432,6 +458,7 @@ void mt7601u_cleanup(struct mt7601u_dev *dev)
 	if (!test_and_clear_bit(MT7601U_STATE_INITIALIZED, &dev->state))
 		return;
 
+	mt7601u_pktgen_stop(dev);
 	mt7601u_stop_hardware(dev);
 	mt7601u_dma_cleanup(dev);
 	mt7601u_mcu_cmd_deinit(dev);
@@ -453,13 +480,23 @@ struct mt7601u_dev *mt7601u_alloc_device(struct device *pdev)
 	mutex_init(&dev->reg_atomic_mutex);
 	mutex_init(&dev->hw_atomic_mutex);
 	mutex_init(&dev->mutex);
-	spin_lock_init(&dev->tx_lock);
+	mutex_init(&dev->prot.lock);
+	mutex_init(&dev->ampdu.lock);
+	mutex_init(&dev->burst.lock);
 	spin_lock_init(&dev->rx_lock);
-	spin_lock_init(&dev->lock);
 	spin_lock_init(&dev->mac_lock);
-	spin_lock_init(&dev->con_mon_lock);
+	seqcount_init(&dev->con_mon_seq);
 	atomic_set(&dev->avg_ampdu_len, 1);
 	skb_queue_head_init(&dev->tx_skb_done);
+	init_waitqueue_head(&dev->tx_flush_wq);
+	mt7601u_pktgen_init(dev);
+	mt7601u_scan_init(dev);
+
+	memcpy(dev->tx_ring_size, tx_ring_size, sizeof(tx_ring_size));
+	dev->tx_wake_div = tx_wake_div;
+	dev->burst.mode = tx_burst;
+	dev->burst.hw_q = -1;
+	dev->cal_cache.enabled = 1;
 
 	dev->stat_wq = alloc_workqueue("mt7601u", WQ_UNBOUND, 0);
 	if (!dev->stat_wq) {
@@ -610,9 +647,19 @@ int mt7601u_register_device(struct mt7601u_dev *dev)
 	ieee80211_hw_set(hw, TX_STATS_EVERY_MPDU);
 #endif
 	ieee80211_hw_set(hw, SUPPORTS_RC_TABLE);
-	hw->max_rates = 1;
+	hw->max_rates = IEEE80211_TX_RATE_TABLE_SIZE;
 	hw->max_report_rates = 7;
-	hw->max_rate_tries = 1;
+	hw->max_rate_tries = MT_MRR_MAX_TRIES;
+
+	hw->extra_tx_headroom = MT_TX_HEADROOM;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 6, 0)
+	if (tx_csum)
+		hw->netdev_features |= NETIF_F_IP_CSUM | NETIF_F_IPV6_CSUM;
+	if (rx_csum) {
+		hw->netdev_features |= NETIF_F_RXCSUM;
+		dev->rx_csum = true;
+	}
+#endif
 
 	hw->sta_data_size = sizeof(struct mt76_sta);
 	hw->vif_data_size = sizeof(struct mt76_vif);
@@ -621,6 +668,8 @@ int mt7601u_register_device(struct mt7601u_dev *dev)
 
 	wiphy->features |= NL80211_FEATURE_ACTIVE_MONITOR;
 	wiphy->interface_modes = BIT(NL80211_IFTYPE_STATION);
+	wiphy->max_scan_ssids = MT_SCAN_MAX_SSIDS;
+	wiphy->max_scan_ie_len = IEEE80211_MAX_DATA_LEN;
 
 	ret = mt76_init_sband_2g(dev);
 	if (ret)
@@ -628,6 +677,12 @@ int mt7601u_register_device(struct mt7601u_dev *dev)
 
 	INIT_DELAYED_WORK(&dev->mac_work, mt7601u_mac_work);
 	INIT_DELAYED_WORK(&dev->stat_work, mt7601u_tx_stat);
+	INIT_WORK(&dev->mrr.work, mt7601u_mac_mrr_work);
+	dev->mrr.ht_fbk = MT_HT_FBK_DEFAULT;
+	dev->mrr.tries = 1;
+	dev->ampdu.ba_size = MT_AMPDU_BA_MAX;
+	dev->ampdu.factor = IEEE80211_HT_MAX_AMPDU_64K;
+	dev->prot.auto_en = 1;
 
 	ret = ieee80211_register_hw(hw);
 	if (ret)
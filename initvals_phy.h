@@ -18,6 +18,9 @@
 #define RF_REG_PAIR(bank, reg, value)				\
 	{ MT_MCU_MEMMAP_RF | (bank) << 16 | (reg), value }
 
+#define RF_REG_RMW(bank, reg, mask, value)			\
+	{ MT_MCU_MEMMAP_RF | (bank) << 16 | (reg), mask, value }
+
 static const struct mt76_reg_pair rf_central[] = {
 	/* Bank 0 - for central blocks: BG, PLL, XTAL, LO, ADC/DAC */
 	RF_REG_PAIR(0,	 0, 0x02),
@@ -59,23 +59,38 @@ mt76_mac_fill_tx_status(struct mt7601u_dev *dev, struct ieee80211_tx_info *info,
 			struct mt76_tx_status *st)
 {
 	struct ieee80211_tx_rate *rate = info->status.rates;
-	int cur_idx, last_rate;
+	u32 ht_fbk = READ_ONCE(dev->mrr.ht_fbk);
+	struct ieee80211_tx_rate final;
+	int idx, last_rate, skip;
+	bool ht;
 	int i;
 
-	last_rate = min_t(int, st->retry, IEEE80211_TX_MAX_RATES - 1);
-	mt76_mac_process_tx_rate(&rate[last_rate], st->rate);
-	if (last_rate < IEEE80211_TX_MAX_RATES - 1)
-		rate[last_rate + 1].idx = -1;
+	mt76_mac_process_tx_rate(&final, st->rate);
+	ht = final.flags & IEEE80211_TX_RC_MCS;
 
-	cur_idx = rate[last_rate].idx + st->retry;
-	for (i = 0; i <= last_rate; i++) {
-		rate[i].flags = rate[last_rate].flags;
-		rate[i].idx = max_t(int, 0, cur_idx - i);
-		rate[i].count = 1;
+	/* Walk the fallback chain from the requested rate down to the final
+	 * one, each rate was tried @st->tries times.  If the chain is longer
+	 * than the status can describe fold its beginning into the first
+	 * reported rate.
+	 */
+	last_rate = min_t(int, st->hops, IEEE80211_TX_MAX_RATES - 1);
+	skip = st->hops - last_rate;
+
+	idx = ht ? st->req_rate : final.idx + st->hops;
+	for (i = 0; i < st->hops; i++) {
+		if (i >= skip) {
+			rate[i - skip].idx = idx;
+			rate[i - skip].flags = final.flags;
+			rate[i - skip].count = st->tries;
+		}
+		idx = ht ? mt76_mrr_next(ht_fbk, idx) : max(idx - 1, 0);
 	}
+	if (last_rate)
+		rate[0].count += skip * st->tries;
 
-	if (last_rate > 0)
-		rate[last_rate - 1].count = st->retry + 1 - last_rate;
+	rate[last_rate] = final;
+	if (last_rate < IEEE80211_TX_MAX_RATES - 1)
+		rate[last_rate + 1].idx = -1;
 
 #ifdef MAC80211_IS_PATCHED
 	info->status.ampdu_len = atomic_read(&dev->avg_ampdu_len);
@@ -142,12 +157,70 @@ u16 mt76_mac_tx_rate_val(struct mt7601u_dev *dev,
 void mt76_mac_wcid_set_rate(struct mt7601u_dev *dev, struct mt76_wcid *wcid,
 			    const struct ieee80211_tx_rate *rate)
 {
-	unsigned long flags;
+	u16 val;
+	u8 nss;
+
+	val = mt76_mac_tx_rate_val(dev, rate, &nss);
+
+	/* Publish rate and NSS in one go, TX path reads it without locking */
+	WRITE_ONCE(wcid->tx_rate, MT76_SET(MT_WCID_TX_RATE_VAL, val) |
+				  MT76_SET(MT_WCID_TX_RATE_NSS, nss) |
+				  MT_WCID_TX_RATE_SET);
+}
+
+/* Turn the rate table chosen by rate control into the HW fallback chain.
+ * Only HT rates can be chained and HW can only fall back to lower MCSes,
+ * TX status decoding depends on that.  The whole table shares one retry
+ * limit, take it from the first rate.
+ */
+void mt76_mac_mrr_update(struct mt7601u_dev *dev,
+			 struct ieee80211_sta_rates *rates)
+{
+	u32 ht_fbk = MT_HT_FBK_DEFAULT;
+	int cur, next, i;
+	u8 tries;
+
+	for (i = 0; i < IEEE80211_TX_RATE_TABLE_SIZE - 1; i++) {
+		cur = rates->rate[i].idx;
+		next = rates->rate[i + 1].idx;
+
+		if (cur < 0 || next < 0 ||
+		    !(rates->rate[i].flags & IEEE80211_TX_RC_MCS) ||
+		    !(rates->rate[i + 1].flags & IEEE80211_TX_RC_MCS) ||
+		    cur > 7 || next >= cur)
+			break;
+
+		ht_fbk &= ~(0xf << (cur * 4));
+		ht_fbk |= next << (cur * 4);
+	}
+
+	tries = clamp_t(u8, rates->rate[0].count, 1, MT_MRR_MAX_TRIES);
+
+	if (ht_fbk == READ_ONCE(dev->mrr.ht_fbk) &&
+	    tries == READ_ONCE(dev->mrr.tries))
+		return;
+
+	WRITE_ONCE(dev->mrr.ht_fbk, ht_fbk);
+	WRITE_ONCE(dev->mrr.tries, tries);
+	ieee80211_queue_work(dev->hw, &dev->mrr.work);
+}
+
+void mt7601u_mac_mrr_work(struct work_struct *work)
+{
+	struct mt7601u_dev *dev = container_of(work, struct mt7601u_dev,
+					       mrr.work);
+	u8 tries = READ_ONCE(dev->mrr.tries);
 
-	spin_lock_irqsave(&dev->lock, flags);
-	wcid->tx_rate = mt76_mac_tx_rate_val(dev, rate, &wcid->tx_rate_nss);
-	wcid->tx_rate_set = true;
-	spin_unlock_irqrestore(&dev->lock, flags);
+	/* Note: dev->mutex can't be taken here, mt7601u_stop() cancels this
+	 *	 work while holding it.  Registers always get the latest values,
+	 *	 so racing with BSS_CHANGED_BASIC_RATES is harmless.
+	 */
+	mt7601u_wr(dev, MT_HT_FBK_CFG0, READ_ONCE(dev->mrr.ht_fbk));
+	/* Limits count retries at a rate before falling back */
+	mt76_rmw(dev, MT_TX_FBK_LIMIT,
+		 MT_TX_FBK_LIMIT_MPDU_FBK | MT_TX_FBK_LIMIT_AMPDU_FBK,
+		 MT76_SET(MT_TX_FBK_LIMIT_MPDU_FBK, tries - 1) |
+		 MT76_SET(MT_TX_FBK_LIMIT_AMPDU_FBK, tries - 1));
 }
 
 struct mt76_tx_status mt7601u_mac_fetch_tx_status(struct mt7601u_dev *dev)
@@ -167,14 +240,15 @@ struct mt76_tx_status mt7601u_mac_fetch_tx_status(struct mt7601u_dev *dev)
 	return stat;
 }
 
-void mt76_send_tx_status(struct mt7601u_dev *dev, struct mt76_tx_status *stat)
+static void
+mt76_send_one_tx_status(struct mt7601u_dev *dev, struct mt76_tx_status *stat)
 {
 	struct ieee80211_tx_info info = {};
 	struct ieee80211_sta *sta = NULL;
 	struct mt76_wcid *wcid = NULL;
+	struct sk_buff *skb = NULL;
 	void *msta;
 
-	rcu_read_lock();
 	if (stat->wcid < ARRAY_SIZE(dev->wcid))
 		wcid = rcu_dereference(dev->wcid[stat->wcid]);
 
@@ -182,20 +256,49 @@ void mt76_send_tx_status(struct mt7601u_dev *dev, struct mt76_tx_status *stat)
 		msta = container_of(wcid, struct mt76_sta, wcid);
 		sta = container_of(msta, struct ieee80211_sta,
 				   drv_priv);
+		skb = mt7601u_tx_pending_get(dev, wcid, stat->pktid);
+	}
+
+	mt7601u_tx_status_dec(dev, stat, wcid, skb);
+
+	if (skb) {
+		struct ieee80211_tx_info *skb_info = IEEE80211_SKB_CB(skb);
+
+		ieee80211_tx_info_clear_status(skb_info);
+		mt76_mac_fill_tx_status(dev, skb_info, stat);
+		dev->tx_status_stats.matched++;
+
+		ieee80211_tx_status(dev->hw, skb);
+	} else {
+		mt76_mac_fill_tx_status(dev, &info, stat);
+		dev->tx_status_stats.noskb++;
+
+		ieee80211_tx_status_noskb(dev->hw, sta, &info);
 	}
+}
 
-	mt76_mac_fill_tx_status(dev, &info, stat);
+/* Report a batch of entries drained from the TX_STAT_FIFO with mac80211's
+ * tx status path locked out only once.
+ */
+void mt76_send_tx_status(struct mt7601u_dev *dev, struct mt76_tx_status *stat,
+			 int n)
+{
+	int i;
 
+	rcu_read_lock();
 	spin_lock_bh(&dev->mac_lock);
-	ieee80211_tx_status_noskb(dev->hw, sta, &info);
-	spin_unlock_bh(&dev->mac_lock);
 
+	for (i = 0; i < n; i++)
+		mt76_send_one_tx_status(dev, &stat[i]);
+
+	spin_unlock_bh(&dev->mac_lock);
 	rcu_read_unlock();
 }
 
-void mt7601u_mac_set_protection(struct mt7601u_dev *dev, bool legacy_prot,
-				int ht_mode)
+static void mt7601u_mac_prot_apply(struct mt7601u_dev *dev)
 {
+	bool legacy_prot = dev->prot.legacy_prot;
+	int ht_mode = dev->prot.ht_mode;
 	int mode = ht_mode & IEEE80211_HT_OP_MODE_PROTECTION;
 	bool non_gf = !!(ht_mode & IEEE80211_HT_OP_MODE_NON_GF_STA_PRSNT);
 	u32 prot[6];
@@ -244,14 +347,93 @@ void mt7601u_mac_set_protection(struct mt7601u_dev *dev, bool legacy_prot,
 	if (non_gf)
 		ht_rts[2] = ht_rts[3] = true;
 
+	/* Aggregates are always HT, extra protection only goes there */
 	for (i = 0; i < 4; i++)
-		if (ht_rts[i])
+		if (ht_rts[i] || dev->prot.level == MT_PROT_LVL_RTS_CTS)
 			prot[i + 2] |= MT_PROT_CTRL_RTS_CTS;
+		else if (dev->prot.level == MT_PROT_LVL_CTS2SELF)
+			prot[i + 2] |= MT_PROT_CTRL_CTS2SELF;
 
 	for (i = 0; i < 6; i++)
 		mt7601u_wr(dev, MT_CCK_PROT_CFG + i * 4, prot[i]);
 }
 
+void mt7601u_mac_set_protection(struct mt7601u_dev *dev, bool legacy_prot,
+				int ht_mode)
+{
+	mutex_lock(&dev->prot.lock);
+	dev->prot.legacy_prot = legacy_prot;
+	dev->prot.ht_mode = ht_mode;
+	mt7601u_mac_prot_apply(dev);
+	mutex_unlock(&dev->prot.lock);
+}
+
+/* Escalate protection of HT frames (none -> CTS-to-self -> RTS/CTS) after
+ * MT_PROT_UP_HOLD bad periods, step back down after MT_PROT_DOWN_HOLD good
+ * ones.  The gap between HIGH and LOW thresholds plus the hold counts keep
+ * the policy from flapping.
+ */
+static void mt7601u_mac_prot_update(struct mt7601u_dev *dev)
+{
+	struct mt7601u_prot_policy *p = &dev->prot;
+	u64 success = dev->stats.tx_stat[2], retry = dev->stats.tx_stat[3];
+	u64 fail = dev->stats.tx_stat[0];
+	u64 d_success, d_retry, d_fail, tries, sent;
+	u32 level = p->level;
+
+	d_success = success - p->prev_success;
+	d_retry = retry - p->prev_retry;
+	d_fail = fail - p->prev_fail;
+	p->prev_success = success;
+	p->prev_retry = retry;
+	p->prev_fail = fail;
+
+	tries = d_success + d_retry;
+	sent = d_success + d_fail;
+	p->retry_pct = tries ? div64_u64(d_retry * 100, tries) : 0;
+	p->fail_pct = sent ? div64_u64(d_fail * 100, sent) : 0;
+
+	/* Disabled or too little traffic to judge - fall back to what the BSS
+	 * requires.
+	 */
+	if (!p->auto_en ||
+	    d_success + d_retry + d_fail < MT_AMPDU_TUNE_MIN_TX) {
+		level = MT_PROT_LVL_BSS;
+		p->up_cnt = 0;
+		p->down_cnt = 0;
+	} else if (p->retry_pct > MT_PROT_RETRY_HIGH ||
+		   p->fail_pct > MT_PROT_FAIL_HIGH) {
+		p->down_cnt = 0;
+		if (++p->up_cnt >= MT_PROT_UP_HOLD &&
+		    level < MT_PROT_LVL_RTS_CTS) {
+			level++;
+			p->up_cnt = 0;
+		}
+	} else if (p->retry_pct < MT_PROT_RETRY_LOW &&
+		   p->fail_pct < MT_PROT_FAIL_LOW) {
+		p->up_cnt = 0;
+		if (++p->down_cnt >= MT_PROT_DOWN_HOLD &&
+		    level > MT_PROT_LVL_BSS) {
+			level--;
+			p->down_cnt = 0;
+		}
+	} else {
+		p->up_cnt = 0;
+		p->down_cnt = 0;
+	}
+
+	if (level == p->level)
+		return;
+
+	trace_mt_prot_policy(dev, p->level, level, p->retry_pct, p->fail_pct);
+
+	mutex_lock(&p->lock);
+	p->level = level;
+	p->changes++;
+	mt7601u_mac_prot_apply(dev);
+	mutex_unlock(&p->lock);
+}
+
 void mt7601u_mac_set_short_preamble(struct mt7601u_dev *dev, bool short_preamb)
 {
 	if (short_preamb)
@@ -294,6 +476,101 @@ static void mt7601u_check_mac_err(struct mt7601u_dev *dev)
 	mt76_clear(dev, MT_MAC_SYS_CTRL, MT_MAC_SYS_CTRL_RESET_CSR);
 }
 
+static void __mt7601u_mac_set_ampdu_factor(struct mt7601u_dev *dev)
+{
+	struct ieee80211_sta *sta;
+	struct mt76_wcid *wcid;
+	void *msta;
+	u8 min_factor = min_t(u32, dev->ampdu.factor,
+			      IEEE80211_HT_MAX_AMPDU_64K);
+	int i;
+
+	rcu_read_lock();
+	for (i = 0; i < ARRAY_SIZE(dev->wcid); i++) {
+		wcid = rcu_dereference(dev->wcid[i]);
+		if (!wcid)
+			continue;
+
+		msta = container_of(wcid, struct mt76_sta, wcid);
+		sta = container_of(msta, struct ieee80211_sta, drv_priv);
+
+		min_factor = min(min_factor, sta->ht_cap.ampdu_factor);
+	}
+	rcu_read_unlock();
+
+	mt7601u_wr(dev, MT_MAX_LEN_CFG, 0xa0fff |
+		   MT76_SET(MT_MAX_LEN_CFG_AMPDU, min_factor));
+}
+
+void mt7601u_mac_set_ampdu_factor(struct mt7601u_dev *dev)
+{
+	mutex_lock(&dev->ampdu.lock);
+	__mt7601u_mac_set_ampdu_factor(dev);
+	mutex_unlock(&dev->ampdu.lock);
+}
+
+/* Max A-MPDU length exponent needed for @ba_size full-sized MPDUs */
+static u32 mt7601u_ampdu_factor(u32 ba_size)
+{
+	u32 len = DIV_ROUND_UP(ba_size * IEEE80211_MAX_FRAME_LEN,
+			       IEEE80211_MIN_AMPDU_BUF * 1024);
+
+	return min_t(u32, order_base_2(len), IEEE80211_HT_MAX_AMPDU_64K);
+}
+
+/* Retry-driven AIMD on the BA window: halve it when many MPDUs need
+ * retries, grow it linearly when links are clean and aggregates actually
+ * fill the window.  Once the window is at minimum and retries stay high
+ * the receiver is likely to be overrun, so MPDU density is increased.
+ * Max A-MPDU length follows the window.
+ */
+static void mt7601u_mac_ampdu_tune(struct mt7601u_dev *dev, u32 avg_len)
+{
+	struct mt7601u_ampdu_tune *t = &dev->ampdu;
+	u64 success = dev->stats.tx_stat[2], retry = dev->stats.tx_stat[3];
+	u32 ba = t->ba_size, density = t->density;
+	u64 d_success, d_retry;
+
+	d_success = success - t->prev_success;
+	d_retry = retry - t->prev_retry;
+	t->prev_success = success;
+	t->prev_retry = retry;
+
+	t->avg_len = avg_len;
+	if (d_success + d_retry < MT_AMPDU_TUNE_MIN_TX)
+		return;
+	t->retry_pct = div64_u64(d_retry * 100, d_success + d_retry);
+
+	if (t->manual)
+		return;
+
+	if (t->retry_pct > MT_AMPDU_RETRY_HIGH) {
+		if (ba > MT_AMPDU_BA_MIN)
+			ba = max_t(u32, ba / 2, MT_AMPDU_BA_MIN);
+		else if (density < IEEE80211_HT_MPDU_DENSITY_16)
+			density++;
+	} else if (t->retry_pct < MT_AMPDU_RETRY_LOW) {
+		if (density)
+			density--;
+		else if (avg_len * 4 >= ba * 3)
+			ba = min_t(u32, ba + MT_AMPDU_BA_STEP, MT_AMPDU_BA_MAX);
+	}
+
+	if (ba == t->ba_size && density == t->density)
+		return;
+
+	WRITE_ONCE(t->ba_size, ba);
+	WRITE_ONCE(t->density, density);
+	t->adjust++;
+
+	mutex_lock(&t->lock);
+	if (mt7601u_ampdu_factor(ba) != t->factor) {
+		t->factor = mt7601u_ampdu_factor(ba);
+		__mt7601u_mac_set_ampdu_factor(dev);
+	}
+	mutex_unlock(&t->lock);
+}
+
 void mt7601u_mac_work(struct work_struct *work)
 {
 	struct mt7601u_dev *dev = container_of(work, struct mt7601u_dev,
@@ -342,6 +619,10 @@ void mt7601u_mac_work(struct work_struct *work)
 
 	atomic_set(&dev->avg_ampdu_len, n ? DIV_ROUND_CLOSEST(sum, n) : 1);
 
+	mt7601u_mac_ampdu_tune(dev, n ? DIV_ROUND_CLOSEST(sum, n) : 0);
+	mt7601u_tx_burst_update(dev);
+	mt7601u_mac_prot_update(dev);
+
 	mt7601u_check_mac_err(dev);
 
 	ieee80211_queue_delayed_work(dev->hw, &dev->mac_work, 10 * HZ);
@@ -364,31 +645,6 @@ mt7601u_mac_wcid_setup(struct mt7601u_dev *dev, u8 idx, u8 vif_idx, u8 *mac)
 	mt7601u_addr_wr(dev, MT_WCID_ADDR(idx), zmac);
 }
 
-void mt7601u_mac_set_ampdu_factor(struct mt7601u_dev *dev)
-{
-	struct ieee80211_sta *sta;
-	struct mt76_wcid *wcid;
-	void *msta;
-	u8 min_factor = 3;
-	int i;
-
-	rcu_read_lock();
-	for (i = 0; i < ARRAY_SIZE(dev->wcid); i++) {
-		wcid = rcu_dereference(dev->wcid[i]);
-		if (!wcid)
-			continue;
-
-		msta = container_of(wcid, struct mt76_sta, wcid);
-		sta = container_of(msta, struct ieee80211_sta, drv_priv);
-
-		min_factor = min(min_factor, sta->ht_cap.ampdu_factor);
-	}
-	rcu_read_unlock();
-
-	mt7601u_wr(dev, MT_MAX_LEN_CFG, 0xa0fff |
-		   MT76_SET(MT_MAX_LEN_CFG_AMPDU, min_factor));
-}
-
 static void
 mt76_mac_process_rate(struct ieee80211_rx_status *status, u16 rate)
 {
@@ -435,22 +691,53 @@ mt76_mac_process_rate(struct ieee80211_rx_status *status, u16 rate)
 		status->flag |= RX_FLAG_40MHZ;
 }
 
+/* Other contexts don't touch connection monitor state directly, they post
+ * requests which the RX tasklet applies before its next update.
+ */
+static void mt7601u_rx_con_mon_reset(struct mt7601u_dev *dev)
+{
+	unsigned long req = xchg(&dev->con_mon_reset, 0);
+
+	if (req & BIT(MT_CON_MON_RESET_RSSI))
+		WRITE_ONCE(dev->avg_rssi, 0);
+	if (req & BIT(MT_CON_MON_RESET_FREQ)) {
+		dev->freq_cal.avg = 0;
+		dev->freq_cal.n_bcn = 0;
+	}
+	if (req & BIT(MT_CON_MON_STOP_ADJ))
+		dev->freq_cal.adjusting = false;
+}
+
+static void mt7601u_rx_monitor_rssi(struct mt7601u_dev *dev, int rssi)
+{
+	WRITE_ONCE(dev->avg_rssi, (dev->avg_rssi * 15) / 16 + (rssi << 8));
+}
+
 static void
 mt7601u_rx_monitor_beacon(struct mt7601u_dev *dev, struct mt7601u_rxwi *rxwi,
 			  u16 rate, int rssi)
 {
-	dev->bcn_freq_off = rxwi->freq_off;
-	dev->bcn_phy_mode = MT76_GET(MT_RXWI_RATE_PHY, rate);
-	dev->avg_rssi = (dev->avg_rssi * 15) / 16 + (rssi << 8);
+	mt7601u_phy_freq_cal_bcn(dev, rxwi->freq_off,
+				 MT76_GET(MT_RXWI_RATE_PHY, rate));
+	mt7601u_rx_monitor_rssi(dev, rssi);
 }
 
-static int
+static bool
 mt7601u_rx_is_our_beacon(struct mt7601u_dev *dev, u8 *data)
 {
 	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)data;
+	unsigned int seq;
+	bool match;
+
+	if (!ieee80211_is_beacon(hdr->frame_control))
+		return false;
 
-	return ieee80211_is_beacon(hdr->frame_control) &&
-		ether_addr_equal(hdr->addr2, dev->ap_bssid);
+	do {
+		seq = read_seqcount_begin(&dev->con_mon_seq);
+		match = ether_addr_equal(hdr->addr2, dev->ap_bssid);
+	} while (read_seqcount_retry(&dev->con_mon_seq, seq));
+
+	return match;
 }
 
 u32 mt76_mac_process_rx(struct mt7601u_dev *dev, struct sk_buff *skb,
@@ -479,12 +766,13 @@ u32 mt76_mac_process_rx(struct mt7601u_dev *dev, struct sk_buff *skb,
 
 	mt76_mac_process_rate(status, rate);
 
-	spin_lock_bh(&dev->con_mon_lock);
+	if (unlikely(READ_ONCE(dev->con_mon_reset)))
+		mt7601u_rx_con_mon_reset(dev);
+
 	if (mt7601u_rx_is_our_beacon(dev, data))
 		mt7601u_rx_monitor_beacon(dev, rxwi, rate, rssi);
 	else if (rxwi->rxinfo & cpu_to_le32(MT_RXINFO_U2M))
-		dev->avg_rssi = (dev->avg_rssi * 15) / 16 + (rssi << 8);
-	spin_unlock_bh(&dev->con_mon_lock);
+		mt7601u_rx_monitor_rssi(dev, rssi);
 
 	return len;
 }
@@ -24,9 +24,22 @@ struct mt76_tx_status {
 	u8 wcid;
 	u8 pktid;
 	u8 retry;
+	u8 req_rate;
+	u8 hops;
+	u8 tries;
 	u16 rate;
 } __packed __aligned(2);
 
+/* Each nibble of MT_HT_FBK_CFG0 holds the MCS the HW falls back to from the
+ * MCS equal to nibble's index, default is to step down one MCS at a time.
+ */
+#define MT_HT_FBK_DEFAULT		0x65432100
+
+static inline u8 mt76_mrr_next(u32 ht_fbk, u8 mcs)
+{
+	return (ht_fbk >> (mcs * 4)) & 0x7;
+}
+
 /* Note: values in original "RSSI" and "SNR" fields are not actually what they
  *	 are called for MT7601U, names used by this driver are educated guesses
  *	 (see vendor mac/ral_omac.c).
@@ -131,6 +144,11 @@ struct mt76_txwi {
 	__le16 ctl;
 } __packed __aligned(4);
 
+/* Space needed in front of the 802.11 header: 4B TXINFO, TXWI and 2B of
+ * padding for headers whose length is not a multiple of 4.
+ */
+#define MT_TX_HEADROOM			(4 + sizeof(struct mt76_txwi) + 2)
+
 #define MT_TXWI_FLAGS_FRAG		BIT(0)
 #define MT_TXWI_FLAGS_MMPS		BIT(1)
 #define MT_TXWI_FLAGS_CFACK		BIT(2)
@@ -173,6 +191,12 @@ u16 mt76_mac_tx_rate_val(struct mt7601u_dev *dev,
 			 const struct ieee80211_tx_rate *rate, u8 *nss_val);
 struct mt76_tx_status
 mt7601u_mac_fetch_tx_status(struct mt7601u_dev *dev);
-void mt76_send_tx_status(struct mt7601u_dev *dev, struct mt76_tx_status *stat);
+void mt7601u_tx_status_dec(struct mt7601u_dev *dev,
+			   struct mt76_tx_status *stat, struct mt76_wcid *wcid,
+			   struct sk_buff *skb);
+void mt76_send_tx_status(struct mt7601u_dev *dev, struct mt76_tx_status *stat,
+			 int n);
+void mt76_mac_mrr_update(struct mt7601u_dev *dev,
+			 struct ieee80211_sta_rates *rates);
 
 #endif
@@ -28,14 +28,19 @@ static int mt7601u_start(struct ieee80211_hw *hw)
 
 	mutex_lock(&dev->mutex);
 
+	ret = mt7601u_dma_resize_tx(dev);
+	if (ret)
+		goto out;
+
+	mt7601u_tx_burst_reset(dev);
+
 	ret = mt7601u_mac_start(dev);
 	if (ret)
 		goto out;
 
 	ieee80211_queue_delayed_work(dev->hw, &dev->mac_work,
 				     MT_CALIBRATE_INTERVAL);
-	ieee80211_queue_delayed_work(dev->hw, &dev->cal_work,
-				     MT_CALIBRATE_INTERVAL);
+	mt7601u_phy_cal_restart(dev);
 out:
 	mutex_unlock(&dev->mutex);
 	return ret;
@@ -49,6 +54,7 @@ static void mt7601u_stop(struct ieee80211_hw *hw)
 
 	cancel_delayed_work_sync(&dev->cal_work);
 	cancel_delayed_work_sync(&dev->mac_work);
+	cancel_work_sync(&dev->mrr.work);
 	mt7601u_mac_stop(dev);
 
 	mutex_unlock(&dev->mutex);
@@ -164,7 +170,7 @@ mt7601u_bss_info_changed(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
 
 	if (changed & BSS_CHANGED_BASIC_RATES) {
 		mt7601u_wr(dev, MT_LEGACY_BASIC_RATE, info->basic_rates);
-		mt7601u_wr(dev, MT_HT_FBK_CFG0, 0x65432100);
+		mt7601u_wr(dev, MT_HT_FBK_CFG0, READ_ONCE(dev->mrr.ht_fbk));
 		mt7601u_wr(dev, MT_HT_FBK_CFG1, 0xedcba980);
 		mt7601u_wr(dev, MT_LG_FBK_CFG0, 0xedcba988);
 		mt7601u_wr(dev, MT_LG_FBK_CFG1, 0x00002100);
@@ -235,6 +241,7 @@ mt7601u_sta_add(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
 
 	msta->wcid.idx = idx;
 	msta->wcid.hw_key_idx = -1;
+	skb_queue_head_init(&msta->wcid.tx_pending);
 	mt7601u_mac_wcid_setup(dev, idx, mvif->idx, sta->addr);
 	mt76_clear(dev, MT_WCID_DROP(idx), MT_WCID_DROP_MASK(idx));
 	rcu_assign_pointer(dev->wcid[idx], &msta->wcid);
@@ -262,6 +269,9 @@ mt7601u_sta_remove(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
 	mt7601u_mac_set_ampdu_factor(dev);
 	mutex_unlock(&dev->mutex);
 
+	synchronize_rcu();
+	mt7601u_tx_pending_purge(dev, &msta->wcid);
+
 	return 0;
 }
 
@@ -271,27 +281,6 @@ mt7601u_sta_notify(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
 {
 }
 
-static void
-mt7601u_sw_scan(struct ieee80211_hw *hw,
-		struct ieee80211_vif *vif,
-		const u8 *mac_addr)
-{
-	struct mt7601u_dev *dev = hw->priv;
-
-	mt7601u_agc_save(dev);
-	set_bit(MT7601U_STATE_SCANNING, &dev->state);
-}
-
-static void
-mt7601u_sw_scan_complete(struct ieee80211_hw *hw,
-			 struct ieee80211_vif *vif)
-{
-	struct mt7601u_dev *dev = hw->priv;
-
-	mt7601u_agc_restore(dev);
-	clear_bit(MT7601U_STATE_SCANNING, &dev->state);
-}
-
 static int
 mt7601u_set_key(struct ieee80211_hw *hw, enum set_key_cmd cmd,
 		struct ieee80211_vif *vif, struct ieee80211_sta *sta,
@@ -404,6 +393,7 @@ mt76_sta_rate_tbl_update(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
 	rate.idx = rates->rate[0].idx;
 	rate.flags = rates->rate[0].flags;
 	mt76_mac_wcid_set_rate(dev, &msta->wcid, &rate);
+	mt76_mac_mrr_update(dev, rates);
 
 out:
 	rcu_read_unlock();
@@ -423,9 +413,9 @@ const struct ieee80211_ops mt7601u_ops = {
 	.sta_notify = mt7601u_sta_notify,
 	.set_key = mt7601u_set_key,
 	.conf_tx = mt7601u_conf_tx,
-	.sw_scan_start = mt7601u_sw_scan,
-	.sw_scan_complete = mt7601u_sw_scan_complete,
-/*	.flush = mt7601u_flush,*/
+	.hw_scan = mt7601u_hw_scan,
+	.cancel_hw_scan = mt7601u_cancel_hw_scan,
+	.flush = mt7601u_flush,
 	.ampdu_action = mt76_ampdu_action,
 	.sta_rate_tbl_update = mt76_sta_rate_tbl_update,
 	.set_rts_threshold = mt7601u_set_rts_threshold,
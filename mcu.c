@@ -72,6 +72,23 @@ mt7601u_mcu_msg_alloc(struct mt7601u_dev *dev, const void *data, int len)
 	return skb;
 }
 
+static void
+mt7601u_mcu_read_resp(struct mt7601u_dev *dev, const u8 *data, int len)
+{
+	struct mt76_reg_pair *rp = dev->mcu.rp;
+	u32 reg;
+	int i;
+
+	if (WARN_ON_ONCE(len < dev->mcu.rp_len * 8))
+		return;
+
+	for (i = 0; i < dev->mcu.rp_len; i++) {
+		reg = get_unaligned_le32(data + i * 8) - dev->mcu.rp_base;
+		WARN_ON_ONCE(reg != rp[i].reg);
+		rp[i].value = get_unaligned_le32(data + i * 8 + 4);
+	}
+}
+
 static int mt7601u_mcu_wait_resp(struct mt7601u_dev *dev, u8 seq)
 {
 	struct urb *urb = dev->mcu.resp.urb;
@@ -88,6 +105,10 @@ static int mt7601u_mcu_wait_resp(struct mt7601u_dev *dev, u8 seq)
 		/* Make copies of important data before reusing the urb */
 		rxfce = get_unaligned_le32(dev->mcu.resp.buf);
 		urb_status = urb->status * mt7601u_urb_has_error(urb);
+		if (!urb_status && dev->mcu.rp &&
+		    MT76_GET(MT_RXD_CMD_INFO_CMD_SEQ, rxfce) == seq)
+			mt7601u_mcu_read_resp(dev, dev->mcu.resp.buf + 4,
+					      urb->actual_length - 8);
 
 		ret = mt7601u_usb_submit_buf(dev, USB_DIR_IN, MT_EP_IN_CMD_RESP,
 					     &dev->mcu.resp, GFP_KERNEL,
@@ -113,9 +134,10 @@ static int mt7601u_mcu_wait_resp(struct mt7601u_dev *dev, u8 seq)
 	return -ETIMEDOUT;
 }
 
+/* Caller must hold dev->mcu.mutex */
 static int
-mt7601u_mcu_msg_send(struct mt7601u_dev *dev, struct sk_buff *skb,
-		     enum mcu_cmd cmd, bool wait_resp)
+__mt7601u_mcu_msg_send(struct mt7601u_dev *dev, struct sk_buff *skb,
+		       enum mcu_cmd cmd, bool wait_resp)
 {
 	struct usb_device *usb_dev = mt7601u_to_usb_dev(dev);
 	unsigned cmd_pipe = usb_sndbulkpipe(usb_dev,
@@ -126,8 +148,6 @@ mt7601u_mcu_msg_send(struct mt7601u_dev *dev, struct sk_buff *skb,
 	if (test_bit(MT7601U_STATE_REMOVED, &dev->state))
 		return 0;
 
-	mutex_lock(&dev->mcu.mutex);
-
 	if (wait_resp)
 		while (!seq)
 			seq = ++dev->mcu.msg_seq & 0xf;
@@ -139,6 +159,7 @@ mt7601u_mcu_msg_send(struct mt7601u_dev *dev, struct sk_buff *skb,
 
 	trace_mt_mcu_msg_send_cs(dev, skb, wait_resp);
 	trace_mt_submit_urb_sync(dev, cmd_pipe, skb->len);
+	atomic_inc(&dev->usb_xfers);
 	ret = usb_bulk_msg(usb_dev, cmd_pipe, skb->data, skb->len, &sent, 500);
 	if (ret) {
 		dev_err(dev->dev, "Error: send MCU cmd failed:%d\n", ret);
@@ -150,13 +171,24 @@ mt7601u_mcu_msg_send(struct mt7601u_dev *dev, struct sk_buff *skb,
 	if (wait_resp)
 		ret = mt7601u_mcu_wait_resp(dev, seq);
 out:
-	mutex_unlock(&dev->mcu.mutex);
-
 	consume_skb(skb);
 
 	return ret;
 }
 
+static int
+mt7601u_mcu_msg_send(struct mt7601u_dev *dev, struct sk_buff *skb,
+		     enum mcu_cmd cmd, bool wait_resp)
+{
+	int ret;
+
+	mutex_lock(&dev->mcu.mutex);
+	ret = __mt7601u_mcu_msg_send(dev, skb, cmd, wait_resp);
+	mutex_unlock(&dev->mcu.mutex);
+
+	return ret;
+}
+
 static int mt7601u_mcu_function_select(struct mt7601u_dev *dev,
 				       enum mcu_function func, u32 val)
 {
@@ -203,9 +235,15 @@ mt7601u_mcu_calibrate(struct mt7601u_dev *dev, enum mcu_calibrate cal, u32 val)
 		.id = cpu_to_le32(cal),
 		.value = cpu_to_le32(val),
 	};
+	int ret;
 
 	skb = mt7601u_mcu_msg_alloc(dev, &msg, sizeof(msg));
-	return mt7601u_mcu_msg_send(dev, skb, CMD_CALIBRATION_OP, true);
+	ret = mt7601u_mcu_msg_send(dev, skb, CMD_CALIBRATION_OP, true);
+
+	/* Calibration rewrites BBP/RF registers, cached values are stale */
+	mt7601u_phy_shadow_reset(dev);
+
+	return ret;
 }
 
 int mt7601u_write_reg_pairs(struct mt7601u_dev *dev, u32 base,
@@ -234,9 +272,85 @@ int mt7601u_write_reg_pairs(struct mt7601u_dev *dev, u32 base,
 	if (ret)
 		return ret;
 
+	for (i = 0; i < cnt; i++)
+		mt7601u_phy_shadow_wr(dev, base + data[i].reg, data[i].value);
+
 	return mt7601u_write_reg_pairs(dev, base, data + cnt, n - cnt);
 }
 
+int mt7601u_read_reg_pairs(struct mt7601u_dev *dev, u32 base,
+			   struct mt76_reg_pair *data, int n)
+{
+	const int max_vals_per_cmd = INBAND_PACKET_MAX_LEN / 8;
+	struct sk_buff *skb;
+	int cnt, i, ret;
+
+	if (!n)
+		return 0;
+
+	cnt = min(max_vals_per_cmd, n);
+
+	skb = alloc_skb(cnt * 8 + MT_DMA_HDR_LEN + 4, GFP_KERNEL);
+	if (!skb)
+		return -ENOMEM;
+	skb_reserve(skb, MT_DMA_HDR_LEN);
+
+	for (i = 0; i < cnt; i++) {
+		skb_put_le32(skb, base + data[i].reg);
+		skb_put_le32(skb, 0);
+	}
+
+	mutex_lock(&dev->mcu.mutex);
+
+	dev->mcu.rp = data;
+	dev->mcu.rp_len = cnt;
+	dev->mcu.rp_base = base;
+	ret = __mt7601u_mcu_msg_send(dev, skb, CMD_RANDOM_READ, true);
+	dev->mcu.rp = NULL;
+
+	mutex_unlock(&dev->mcu.mutex);
+
+	if (ret)
+		return ret;
+
+	return mt7601u_read_reg_pairs(dev, base, data + cnt, n - cnt);
+}
+
+/* Each entry is applied by the MCU as reg = (reg & ~mask) | value */
+int mt7601u_rmw_regs(struct mt7601u_dev *dev, u32 base,
+		     const struct mt76_reg_rmw *data, int n)
+{
+	const int max_vals_per_cmd = INBAND_PACKET_MAX_LEN / 12;
+	struct sk_buff *skb;
+	int cnt, i, ret;
+
+	if (!n)
+		return 0;
+
+	cnt = min(max_vals_per_cmd, n);
+
+	skb = alloc_skb(cnt * 12 + MT_DMA_HDR_LEN + 4, GFP_KERNEL);
+	if (!skb)
+		return -ENOMEM;
+	skb_reserve(skb, MT_DMA_HDR_LEN);
+
+	for (i = 0; i < cnt; i++) {
+		skb_put_le32(skb, base + data[i].reg);
+		skb_put_le32(skb, data[i].mask);
+		skb_put_le32(skb, data[i].value);
+	}
+
+	ret = mt7601u_mcu_msg_send(dev, skb, CMD_READ_MODIFY_WRITE, cnt == n);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < cnt; i++)
+		mt7601u_phy_shadow_rmw(dev, base + data[i].reg,
+				       data[i].mask, data[i].value);
+
+	return mt7601u_rmw_regs(dev, base, data + cnt, n - cnt);
+}
+
 int mt7601u_burst_write_regs(struct mt7601u_dev *dev, u32 offset,
 			     const u32 *data, int n)
 {
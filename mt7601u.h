@@ -27,10 +27,22 @@
 #include "util.h"
 
 #define MT_CALIBRATE_INTERVAL		(4 * HZ)
+#define MT_CAL_INTERVAL_MAX		(32 * HZ)
+#define MT_CAL_RSSI_DELTA		3 /* dB */
+#define MT_CAL_TEMP_DELTA		2 /* raw BBP R47 units */
 
 #define MT_FREQ_CAL_INIT_DELAY		(30 * HZ)
-#define MT_FREQ_CAL_CHECK_INTERVAL	(10 * HZ)
 #define MT_FREQ_CAL_ADJ_INTERVAL	(HZ / 2)
+#define MT_FREQ_CAL_EWMA_WEIGHT		8
+#define MT_FREQ_CAL_MIN_BCN		4
+
+#define MT_TX_FLUSH_TIMEOUT		(HZ / 2)
+#define MT_TX_STATUS_TIMEOUT		250 /* ms */
+
+#define MT_TX_STAT_FIFO_DEPTH		16
+#define MT_TX_STAT_POLL_MIN		2 /* ms */
+#define MT_TX_STAT_POLL_MAX		20 /* ms */
+#define MT_TX_STAT_RATE_SHIFT		4
 
 #define MT_BBP_REG_VERSION		0x00
 
@@ -53,13 +65,642 @@ struct mt7601u_mcu {
 
 	struct mt7601u_dma_buf resp;
 	struct completion resp_cmpl;
+
+	/* Destination for values returned by CMD_RANDOM_READ */
+	struct mt76_reg_pair *rp;
+	int rp_len;
+	u32 rp_base;
 };
 
+/**
+ * struct mt7601u_freq_cal - beacon-driven frequency offset correction
+ * @work:	moves the RF frequency offset one step, queued from beacon RX.
+ * @freq:	current RF frequency offset setting.
+ * @enabled:	associated, beacons of our AP are tracked.
+ * @adjusting:	filtered offset went above the activate threshold and
+ *		hasn't yet dropped below the deactivate one.
+ * @step_off:	filtered offset @work should correct.
+ * @phy_mode:	PHY mode of the beacons in @avg.
+ * @avg:	moving average of beacon frequency offsets, scaled by 16.
+ * @n_bcn:	beacons folded into @avg since it was last reset.
+ * @holdoff:	beacons received before this time (jiffies) are ignored,
+ *		lets the RF settle after association or an adjustment.
+ * @beacons:	beacons which updated @avg.
+ * @steps:	RF adjustments made.
+ *
+ * Beacon state (@phy_mode, @avg, @n_bcn, @adjusting, @step_off and
+ * @beacons) is written only by the RX tasklet, @freq and @steps only by
+ * @work.
+ */
 struct mt7601u_freq_cal {
-	struct delayed_work work;
+	struct work_struct work;
 	u8 freq;
 	bool enabled;
 	bool adjusting;
+	int step_off;
+
+	u8 phy_mode;
+	int avg;
+	u32 n_bcn;
+	unsigned long holdoff;
+
+	u32 beacons;
+	u32 steps;
+};
+
+#define MT_TX_BATCH_HIST	8
+
+/**
+ * struct mt7601u_tx_batch_stats - TX completion batching statistics
+ * @hist:	log2 histogram of number of frames reported per tasklet run.
+ * @max:	largest batch seen.
+ * @batches:	number of batches reported.
+ * @skbs:	number of frames reported.
+ *
+ * Only written from the TX tasklet.
+ */
+struct mt7601u_tx_batch_stats {
+	u64 hist[MT_TX_BATCH_HIST];
+	u32 max;
+	u64 batches;
+	u64 skbs;
+};
+
+/**
+ * struct mt7601u_flush_stats - TX flush statistics
+ * @n:		number of flush requests.
+ * @n_drop:	number of requests which asked for frames to be dropped.
+ * @n_timeout:	number of requests which timed out.
+ * @last_us:	duration of the last flush.
+ * @max_us:	longest flush.
+ * @total_us:	sum of durations of all flushes.
+ */
+struct mt7601u_flush_stats {
+	u32 n;
+	u32 n_drop;
+	u32 n_timeout;
+	u32 last_us;
+	u32 max_us;
+	u64 total_us;
+};
+
+#define MT_TX_LAT_HIST		16
+
+enum mt7601u_tx_lat_stage {
+	MT_TX_LAT_QUEUE,
+	MT_TX_LAT_USB,
+	MT_TX_LAT_STATUS,
+	__MT_TX_LAT_MAX
+};
+
+/**
+ * struct mt7601u_tx_lat_stats - per-AC TX latency histograms
+ * @hist:	log2 histograms of time in us frames spent in each stage:
+ *		%MT_TX_LAT_QUEUE from mt7601u_tx() to URB submission,
+ *		%MT_TX_LAT_USB from URB submission to URB completion,
+ *		%MT_TX_LAT_STATUS from URB completion to fetching the frame's
+ *		TX_STAT_FIFO entry (only frames which requested TX status
+ *		and were matched by their rolling PKT_ID with no gap in
+ *		the sequence, expired frames are not accounted).
+ *
+ * Stages of one AC are updated under the lock of its TX ring or from the
+ * TX status work.  Reset without locking, values are approximate.
+ */
+struct mt7601u_tx_lat_stats {
+	u32 hist[IEEE80211_NUM_ACS][__MT_TX_LAT_MAX][MT_TX_LAT_HIST];
+};
+
+/**
+ * struct mt7601u_tx_status_stats - TX status reporting statistics
+ * @matched:	TX_STAT_FIFO entries matched to a pending frame.
+ * @noskb:	TX_STAT_FIFO entries reported without a frame.
+ * @expired:	pending frames which never got a TX_STAT_FIFO entry.
+ * @purged:	pending frames dropped because their station went away.
+ * @lost_req_status: lost statuses of frames which requested TX status,
+ *		detected as rolling PKT_IDs missing from the per-WCID sequence
+ *		of TX_STAT_FIFO entries (counted modulo %MT_PKTID_STATUS_N).
+ *		Lost statuses of other frames can't be detected.
+ * @polls:	number of TX_STAT_FIFO polling runs.
+ * @fifo_full:	polling runs which found the FIFO full (statuses may have
+ *		been dropped by the HW).
+ */
+struct mt7601u_tx_status_stats {
+	u64 matched;
+	u64 noskb;
+	u64 expired;
+	u64 purged;
+	u64 lost_req_status;
+	u64 polls;
+	u64 fifo_full;
+};
+
+/**
+ * struct mt7601u_tx_slow_path - TX frames which needed reallocation
+ * @headroom:	not enough headroom for TXINFO, TXWI and header padding.
+ * @cloned:	enough headroom but header was cloned.
+ * @tailroom:	not enough tailroom for DMA padding.
+ *
+ * Atomic since several CPUs can be in mt7601u_tx() at once, only touched
+ * when the slow path is actually taken.
+ */
+struct mt7601u_tx_slow_path {
+	atomic_t headroom;
+	atomic_t cloned;
+	atomic_t tailroom;
+};
+
+/**
+ * struct mt7601u_csum_stats - checksum offload statistics
+ * @hw:		checksums offloaded to (TX) or verified by (RX) the HW.
+ * @sw:		TX: checksums computed in software because the frame was not
+ *		eligible for offload.  RX: frames the HW did not verify.
+ * @err:	RX: frames the HW found bad checksum in.
+ *
+ * Atomic because the TX side is bumped from mt7601u_tx() which may run on
+ * several CPUs at once.
+ */
+struct mt7601u_csum_stats {
+	atomic_t hw;
+	atomic_t sw;
+	atomic_t err;
+};
+
+/**
+ * struct mt7601u_tx_stat_poll - TX status polling scheduler state
+ * @last:	time of the last polling run.
+ * @rate:	moving average of FIFO entries per ms, fixed point with
+ *		MT_TX_STAT_RATE_SHIFT fractional bits.
+ * @interval:	currently used polling interval in ms.
+ */
+struct mt7601u_tx_stat_poll {
+	ktime_t last;
+	u32 rate;
+	u32 interval;
+};
+
+/**
+ * struct mt7601u_pktgen_stats - results of a traffic generator run
+ * @start:	time the run was started.
+ * @end:	time of the last completion.
+ * @sent:	frames handed to the DMA layer.
+ * @done:	frames completed successfully.
+ * @xmit_failed: frames which could not be handed to the DMA layer.
+ * @failed:	frames which completed with an error.
+ * @bytes:	802.11 bytes (without DMA overhead) completed successfully.
+ * @lat_total_us: sum of submission to completion latencies.
+ * @lat_max_us:	largest submission to completion latency.
+ * @occ_total:	sum of TX ring occupancy sampled before each submission.
+ * @occ_max:	largest TX ring occupancy seen.
+ *
+ * Completion side is only written from the TX tasklet, submission side only
+ * from the generator work.
+ */
+struct mt7601u_pktgen_stats {
+	ktime_t start;
+	ktime_t end;
+	u64 sent;
+	u64 done;
+	u64 xmit_failed;
+	u64 failed;
+	u64 bytes;
+	u64 lat_total_us;
+	u32 lat_max_us;
+	u64 occ_total;
+	u32 occ_max;
+};
+
+/**
+ * struct mt7601u_pktgen_params - traffic generator run parameters
+ * @len:	payload length of generated frames.
+ * @rate:	TXWI rate_ctl value frames are sent with.
+ * @ac:		mac80211 AC frames are queued to.
+ * @wcid:	WCID frames are sent with.
+ * @count:	number of frames to send, 0 means until stopped.
+ * @mock:	complete URBs locally instead of submitting them to USB.
+ */
+struct mt7601u_pktgen_params {
+	u32 len;
+	u32 rate;
+	u32 ac;
+	u32 wcid;
+	u32 count;
+	u32 mock;
+};
+
+/**
+ * struct mt7601u_pktgen - in-driver TX traffic generator, see pktgen.c
+ * @work:	generator loop.
+ * @stop:	asks @work to stop early.
+ * @cfg:	parameters of the next run, writable through debugfs.
+ * @run:	validated copy of @cfg taken when the run was started, the only
+ *		one @work looks at.  Written only while no run is in progress.
+ * @mock_lock:	protects @mock_urbs.
+ * @mock_urbs:	URBs "in flight" in mock mode.
+ * @mock_tasklet: completes @mock_urbs.
+ * @mock_drops:	mac80211 frames dropped because mock mode was active.
+ * @stats:	results of the current or last run.
+ */
+struct mt7601u_pktgen {
+	struct work_struct work;
+	bool stop;
+
+	struct mt7601u_pktgen_params cfg;
+	struct mt7601u_pktgen_params run;
+
+	spinlock_t mock_lock;
+	struct list_head mock_urbs;
+	struct tasklet_struct mock_tasklet;
+	atomic_t mock_drops;
+
+	struct mt7601u_pktgen_stats stats;
+};
+
+#define MT_SCAN_DWELL_ACTIVE	30
+#define MT_SCAN_DWELL_PASSIVE	110
+#define MT_SCAN_CHUNK		3
+#define MT_SCAN_HOME_DWELL	100
+#define MT_SCAN_MAX_SSIDS	4
+
+/**
+ * struct mt7601u_scan - driver-run hardware scan, see scan.c
+ * @work:	walks the channel list, one invocation per dwell.
+ * @req:	request being executed, NULL when idle.
+ * @vif:	interface which requested the scan.
+ * @addr:	TA of probe requests, randomized if the request asks for it.
+ * @chan_idx:	next channel of @req to visit.
+ * @in_chunk:	channels visited since leaving the operating channel.
+ * @on_home:	currently on the operating channel.
+ * @aborted:	scan was cancelled by mac80211.
+ * @assoc:	interface was associated when the scan started, i.e. there
+ *		is a data path to keep serviced.
+ * @start:	time the scan was started.
+ * @off_start:	time the operating channel was left.
+ * @dwell_active: time spent on channels where probes are sent (ms).
+ * @dwell_passive: time spent on channels where we only listen (ms).
+ * @chunk:	channels visited before going back to the operating channel,
+ *		only when associated, 0 means never.
+ * @home_dwell:	time spent on the operating channel between chunks (ms).
+ * @scans:	completed scans.
+ * @aborts:	cancelled scans.
+ * @probes:	probe requests sent.
+ * @last_ms:	duration of the last scan.
+ * @max_ms:	duration of the longest scan.
+ * @interruptions: times data path was suspended while associated.
+ * @off_total_ms: total time the data path was suspended while associated.
+ * @off_max_ms:	longest single suspension of the data path.
+ */
+struct mt7601u_scan {
+	struct delayed_work work;
+	struct ieee80211_scan_request *req;
+	struct ieee80211_vif *vif;
+	u8 addr[ETH_ALEN];
+
+	int chan_idx;
+	int in_chunk;
+	bool on_home;
+	bool aborted;
+	bool assoc;
+
+	ktime_t start;
+	ktime_t off_start;
+
+	u32 dwell_active;
+	u32 dwell_passive;
+	u32 chunk;
+	u32 home_dwell;
+
+	u32 scans;
+	u32 aborts;
+	u32 probes;
+	u32 last_ms;
+	u32 max_ms;
+	u32 interruptions;
+	u64 off_total_ms;
+	u32 off_max_ms;
+};
+
+#define MT_MRR_MAX_TRIES	4
+
+/**
+ * struct mt7601u_mrr - HW multi-rate retry configuration
+ * @ht_fbk:	HT fallback table, mirrors MT_HT_FBK_CFG0.
+ * @tries:	transmissions at each rate before the HW falls back to the
+ *		next one, mirrors MT_TX_FBK_LIMIT.
+ * @work:	programs the registers, rate table updates come from atomic
+ *		context.
+ *
+ * @ht_fbk and @tries are written with WRITE_ONCE() and read with
+ * READ_ONCE() by TX status decoding.
+ */
+struct mt7601u_mrr {
+	u32 ht_fbk;
+	u8 tries;
+	struct work_struct work;
+};
+
+#define MT_AMPDU_BA_MAX		63
+#define MT_AMPDU_BA_MIN		4
+#define MT_AMPDU_BA_STEP	4
+#define MT_AMPDU_TUNE_MIN_TX	100
+#define MT_AMPDU_RETRY_HIGH	25 /* % */
+#define MT_AMPDU_RETRY_LOW	10 /* % */
+
+/**
+ * struct mt7601u_ampdu_tune - A-MPDU parameter feedback loop
+ * @lock:	serializes @factor updates and programming of MT_MAX_LEN_CFG
+ *		between mac_work and station add/remove.
+ * @manual:	don't tune, use values written through debugfs as they are.
+ * @ba_size:	cap on BA window size put in TXWI.
+ * @density:	floor for MPDU density put in TXWI.
+ * @factor:	cap on max A-MPDU length exponent in MT_MAX_LEN_CFG.
+ * @retry_pct:	TX retry ratio seen in the last period.
+ * @avg_len:	average A-MPDU length seen in the last period.
+ * @adjust:	number of times the loop changed the parameters.
+ * @prev_success: MT_TX_STA_CNT1 success count at the end of last period.
+ * @prev_retry:	MT_TX_STA_CNT1 retry count at the end of last period.
+ *
+ * Loop runs from mac_work.  HW counters are global, so the values apply to
+ * all stations on top of limits coming from their own HT capabilities.
+ * TX path reads @ba_size and @density with READ_ONCE().
+ */
+struct mt7601u_ampdu_tune {
+	struct mutex lock;
+	u32 manual;
+	u32 ba_size;
+	u32 density;
+	u32 factor;
+
+	u32 retry_pct;
+	u32 avg_len;
+	u32 adjust;
+
+	u64 prev_success;
+	u64 prev_retry;
+};
+
+#define MT_SHADOW_BBP_REGS	256
+#define MT_SHADOW_RF_BANKS	8
+#define MT_SHADOW_RF_REGS	64
+#define MT_SHADOW_SIZE		(MT_SHADOW_BBP_REGS +			\
+				 MT_SHADOW_RF_BANKS * MT_SHADOW_RF_REGS)
+
+struct mt76_reg_pair {
+	u32 reg;
+	u32 value;
+};
+
+struct mt76_reg_rmw {
+	u32 reg;
+	u32 mask;
+	u32 value;
+};
+
+#define MT_CHAN_PROG_PRE	14
+#define MT_CHAN_PROG_POST	3
+#define MT_CHAN_PROG_N		(14 * 2 * 2)
+
+/**
+ * struct mt7601u_chan_prog - register program for one channel switch
+ * @pre:	RF frequency plan, LNA gain, TX ALC, control channel, BW and
+ *		VCO calibration, written before the BW filter calibration.
+ * @post:	CH14 OBW fixup and TX power, written after it.
+ * @ch14_fixup: program applies CH14 OBW fixup (lowers CCK power).
+ *
+ * One program per (channel, bandwidth, ext channel below) tuple, entries
+ * are absolute MCU memmap addresses.
+ */
+struct mt7601u_chan_prog {
+	struct mt76_reg_rmw pre[MT_CHAN_PROG_PRE];
+	struct mt76_reg_rmw post[MT_CHAN_PROG_POST];
+	bool ch14_fixup;
+};
+
+#define MT_CHSW_LAT_HIST	20
+
+/**
+ * struct mt7601u_chsw_stats - channel switch latency
+ * @hist:	log2 histogram of channel switch time in us.
+ * @last_us:	duration of the last switch.
+ * @max_us:	longest switch.
+ */
+struct mt7601u_chsw_stats {
+	u32 hist[MT_CHSW_LAT_HIST];
+	u32 last_us;
+	u32 max_us;
+};
+
+/**
+ * struct mt7601u_reg_shadow - last known values of BBP and RF registers
+ * @val:	register values, BBP registers first then RF bank by bank.
+ * @valid:	which entries of @val are known.
+ * @hits:	reads served from the shadow.
+ * @misses:	reads of non-volatile registers which went to the HW.
+ *
+ * Entries are filled by writes (direct and through the MCU) and by direct
+ * reads.  Registers the HW changes by itself are never cached.  MCU
+ * calibrations change registers behind our back, so they drop everything.
+ */
+struct mt7601u_reg_shadow {
+	u8 val[MT_SHADOW_SIZE];
+	DECLARE_BITMAP(valid, MT_SHADOW_SIZE);
+
+	u32 hits;
+	u32 misses;
+};
+
+/**
+ * struct mt7601u_cal_state - incremental periodic calibration
+ * @interval:	current calibration period, doubled (up to
+ *		MT_CAL_INTERVAL_MAX) after each run which had nothing to do.
+ * @force:	run all steps on next calibration, set on channel change.
+ * @agc_rssi:	average RSSI (in dBm) AGC was last tuned for.
+ * @temp:	raw temperature temperature compensation was last run for.
+ * @tssi_settled: last TSSI run didn't have to correct TX power.
+ * @runs:	number of calibration runs.
+ * @skip_agc:	number of times AGC tuning was skipped.
+ * @skip_tssi:	number of times TSSI calibration was skipped.
+ * @skip_temp:	number of times temperature compensation was skipped.
+ * @usb_xfers:	USB transactions issued during the last run.
+ * @usb_xfers_total: USB transactions issued by all runs.
+ * @time_us:	wall time of the last run.
+ * @time_max_us: longest run.
+ * @time_total_us: wall time of all runs.
+ *
+ * USB transactions are counted device-wide, anything running in parallel
+ * with calibration (e.g. mac_work) is accounted to it too.
+ */
+struct mt7601u_cal_state {
+	unsigned long interval;
+	bool force;
+
+	int agc_rssi;
+	s8 temp;
+	bool tssi_settled;
+
+	u32 runs;
+	u32 skip_agc;
+	u32 skip_tssi;
+	u32 skip_temp;
+
+	u32 usb_xfers;
+	u64 usb_xfers_total;
+	u32 time_us;
+	u32 time_max_us;
+	u64 time_total_us;
+};
+
+#define MT_CAL_CACHE_SLOTS	4
+#define MT_CAL_CACHE_TEMP_BAND	450
+
+/**
+ * struct mt7601u_cal_cache_entry - init calibration results for one band
+ * @valid:	entry holds results.
+ * @temp_band:	temperature band (in MT_CAL_CACHE_TEMP_BAND units of the
+ *		compensated temperature) the results were taken in.
+ * @used:	jiffies of the last store or replay, oldest entry is replaced.
+ * @tssi_init:	TSSI DC readout.
+ * @tssi_init_hvga: TSSI DC readout with high VGA gain.
+ * @tssi_db:	initial TSSI level (dB).
+ * @tssi_hvga_db: initial TSSI level with high VGA gain (dB).
+ */
+struct mt7601u_cal_cache_entry {
+	bool valid;
+	int temp_band;
+	unsigned long used;
+
+	s8 tssi_init;
+	s8 tssi_init_hvga;
+	s16 tssi_db;
+	s16 tssi_hvga_db;
+};
+
+/**
+ * struct mt7601u_cal_cache - init calibration results kept across resets
+ * @enabled:	replay cached results instead of recalibrating.
+ * @addr:	eFuse MAC address the entries belong to.
+ * @ent:	cached results, one per temperature band.
+ * @hits:	init calibrations which replayed the cache.
+ * @misses:	init calibrations which had to run in full.
+ * @full_us:	duration of the last full init calibration.
+ * @replay_us:	duration of the last init calibration using the cache.
+ *
+ * Results of the MCU calibrations live in RF/BBP state the MCU doesn't
+ * expose, those steps run on every init.  What is cached are the results
+ * computed by the driver - TSSI DC/gain measurement.
+ */
+struct mt7601u_cal_cache {
+	u32 enabled;
+	u8 addr[ETH_ALEN];
+	struct mt7601u_cal_cache_entry ent[MT_CAL_CACHE_SLOTS];
+
+	u32 hits;
+	u32 misses;
+	u32 full_us;
+	u32 replay_us;
+};
+
+enum mt7601u_prot_level {
+	MT_PROT_LVL_BSS,
+	MT_PROT_LVL_CTS2SELF,
+	MT_PROT_LVL_RTS_CTS,
+};
+
+#define MT_PROT_RETRY_HIGH	30 /* % */
+#define MT_PROT_RETRY_LOW	10 /* % */
+#define MT_PROT_FAIL_HIGH	5 /* % */
+#define MT_PROT_FAIL_LOW	1 /* % */
+#define MT_PROT_UP_HOLD		2 /* periods */
+#define MT_PROT_DOWN_HOLD	3 /* periods */
+
+/**
+ * struct mt7601u_prot_policy - adaptive protection for HT frames
+ * @lock:	serializes programming of MT_*_PROT_CFG registers.
+ * @legacy_prot: use of CTS protection requested by the BSS.
+ * @ht_mode:	HT operation mode of the BSS.
+ * @auto_en:	adapt protection to TX statistics.
+ * @level:	extra protection added on top of what the BSS requires,
+ *		one of MT_PROT_LVL_*.
+ * @up_cnt:	consecutive periods with retries or failures over threshold.
+ * @down_cnt:	consecutive periods with retries and failures under
+ *		threshold.
+ * @retry_pct:	TX retry ratio seen in the last period.
+ * @fail_pct:	TX failure ratio seen in the last period.
+ * @changes:	number of times @level changed.
+ * @prev_success: MT_TX_STA_CNT1 success count at the end of last period.
+ * @prev_retry:	MT_TX_STA_CNT1 retry count at the end of last period.
+ * @prev_fail:	MT_TX_STA_CNT0 failure count at the end of last period.
+ *
+ * Policy runs from mac_work which can't take dev->mutex, hence @lock.
+ */
+struct mt7601u_prot_policy {
+	struct mutex lock;
+	bool legacy_prot;
+	int ht_mode;
+
+	u32 auto_en;
+	u32 level;
+	u32 up_cnt;
+	u32 down_cnt;
+
+	u32 retry_pct;
+	u32 fail_pct;
+	u32 changes;
+
+	u64 prev_success;
+	u64 prev_retry;
+	u64 prev_fail;
+};
+
+enum mt7601u_tx_burst_mode {
+	MT_TX_BURST_OFF,
+	MT_TX_BURST_ON,
+	MT_TX_BURST_AUTO,
+};
+
+#define MT_TX_BURST_TXOP	0x60 /* * 32us */
+#define MT_TX_BURST_MIN_FRAMES	1000
+#define MT_TX_BURST_DOMINANT	75 /* % */
+#define MT_TX_BURST_RETRY_MAX	15 /* % */
+
+/**
+ * struct mt7601u_tx_burst - TX burst (long TXOP) control
+ * @lock:	serializes TXOP updates of MT_EDCA_CFG_AC registers between
+ *		mt7601u_tx_burst_update() and mt7601u_conf_tx(), protects
+ *		@txop and changes of @hw_q.
+ * @mode:	one of MT_TX_BURST_*.
+ * @hw_q:	HW queue with the long TXOP, -1 if none.  Read without locking
+ *		by the TX path.  With bursting off it's HW queue 0, like the
+ *		vendor driver does.
+ * @txop:	TXOP configured by mac80211 for each HW queue.
+ * @frames:	frames queued per HW queue in the current period.
+ * @peer_frames: frames queued to stations (rather than multicast or
+ *		without station) in the current period.
+ * @bytes:	bytes queued in the current period.
+ * @last:	start of the current period.
+ * @load_on:	average load (kbit/s) queued to the driver while bursting,
+ *		not the resulting air throughput.
+ * @load_off:	same while not bursting.
+ * @switches:	number of times bursting was turned on, off or moved.
+ *
+ * @frames, @peer_frames and @bytes are bumped from mt7601u_tx() which may
+ * run on several CPUs at once, hence atomic.  mt7601u_tx_burst_update()
+ * collects and zeroes them each period.
+ */
+struct mt7601u_tx_burst {
+	struct mutex lock;
+
+	u32 mode;
+	int hw_q;
+	u16 txop[4];
+
+	atomic_t frames[4];
+	atomic_t peer_frames;
+	atomic64_t bytes;
+	ktime_t last;
+
+	u32 load_on;
+	u32 load_off;
+	u32 switches;
 };
 
 struct mac_stats {
@@ -70,6 +711,22 @@ struct mac_stats {
 	u64 zero_len_del[2];
 };
 
+/**
+ * struct mt7601u_rx_cost - cost of RXWI processing
+ * @enabled:	measure time spent in mt76_mac_process_rx().
+ * @frames:	frames measured.
+ * @time_ns:	total time spent processing @frames.
+ * @max_ns:	slowest frame.
+ *
+ * Written only by the RX tasklet.
+ */
+struct mt7601u_rx_cost {
+	u32 enabled;
+	u64 frames;
+	u64 time_ns;
+	u32 max_ns;
+};
+
 #define N_RX_ENTRIES	16
 struct mt7601u_rx_queue {
 	struct mt7601u_dev *dev;
@@ -86,20 +743,80 @@ struct mt7601u_rx_queue {
 };
 
 #define N_TX_ENTRIES	64
+#define MT_TX_RING_MIN	8
+#define MT_TX_RING_MAX	256
+
+/* Hardware uses mirrored order of queues with Q0 having the highest priority */
+static inline u8 q2hwq(u8 q)
+{
+	return q ^ 0x3;
+}
 
+/**
+ * struct mt7601u_tx_queue_stats - TX ring telemetry
+ * @since:	time collection of statistics started.
+ * @occ_last:	time of the last change of ring occupancy.
+ * @occ_integral: ring occupancy integrated over time (entries * us), used
+ *		to compute time-weighted average occupancy.
+ * @max_used:	highest ring occupancy seen.
+ * @stops:	number of times the ring filled up and its mac80211 queue was
+ *		stopped.
+ * @stop_time:	time the queue was last stopped, valid while stopped.
+ * @stopped_us:	cumulative time the queue spent stopped.
+ * @err_nospc:	submissions to a full ring.
+ * @err_nodev:	submissions which failed because device was gone.
+ * @err_other:	submissions which failed with other errors.
+ * @last_err:	last submission error.
+ * @lock_acq:	ring lock acquisitions by URB submission and completion.
+ * @lock_contended: acquisitions counted in @lock_acq which found the lock
+ *		held and had to spin.
+ */
+struct mt7601u_tx_queue_stats {
+	ktime_t since;
+	ktime_t occ_last;
+	u64 occ_integral;
+	u32 max_used;
+	u32 stops;
+	ktime_t stop_time;
+	u64 stopped_us;
+	u32 err_nospc;
+	u32 err_nodev;
+	u32 err_other;
+	int last_err;
+	u64 lock_acq;
+	u64 lock_contended;
+};
+
+/**
+ * struct mt7601u_tx_queue - TX ring of a single USB OUT endpoint
+ * @lock:	protects ring indexes and entries, taken from both submission
+ *		and URB completion. Rings of different endpoints do not
+ *		contend with each other.  Protects @stopped and @stats too.
+ * @e:		ring entries, @entries of them.  Endpoints not used for data
+ *		have no entries.
+ * @wake_thresh: occupancy at which a stopped mac80211 queue is woken,
+ *		compared after a completion released its entry so that 0
+ *		(tx_wake_div of 1) wakes once the ring has drained.
+ * @stopped:	mac80211 queue was stopped because this ring is full.
+ */
 struct mt7601u_tx_queue {
 	struct mt7601u_dev *dev;
+	spinlock_t lock;
 
 	struct mt7601u_dma_buf_tx {
 		struct urb *urb;
 		struct sk_buff *skb;
-	} e[N_TX_ENTRIES];
+	} *e;
 
 	unsigned int start;
 	unsigned int end;
 	unsigned int entries;
 	unsigned int used;
 	unsigned int fifo_seq;
+	unsigned int wake_thresh;
+
+	bool stopped;
+	struct mt7601u_tx_queue_stats stats;
 };
 
 /* WCID allocation:
@@ -115,7 +832,6 @@ struct mt7601u_tx_queue {
 struct mt7601u_eeprom_params;
 
 #define MT_EE_TEMPERATURE_SLOPE		39
-#define MT_FREQ_OFFSET_INVALID		-128
 
 enum mt_temp_mode {
 	MT_TEMP_MODE_NORMAL,
@@ -136,16 +852,39 @@ enum {
 	MT7601U_STATE_SCANNING,
 	MT7601U_STATE_READING_STATS,
 	MT7601U_STATE_MORE_STATS,
+	MT7601U_STATE_PKTGEN,
+	MT7601U_STATE_MOCK_URB,
+	MT7601U_STATE_FREQ_CAL,
+};
+
+/* Connection monitor reset requests, see mt7601u_dev.con_mon_reset */
+enum {
+	MT_CON_MON_RESET_RSSI,
+	MT_CON_MON_RESET_FREQ,
+	MT_CON_MON_STOP_ADJ,
 };
 
+/* MT7601U_STATE_READING_STATS is set while TX status polling work is
+ * scheduled, MT7601U_STATE_MORE_STATS is set by the TX tasklet whenever new
+ * frames were completed.  Both are manipulated with atomic bitops only, the
+ * polling work re-checks MORE_STATS after clearing READING_STATS so that no
+ * wake up can be lost.
+ *
+ * MT7601U_STATE_FREQ_CAL is taken with test_and_set_bit() by the RX tasklet
+ * when it queues a frequency correction step, or by process context (with
+ * the RX tasklet disabled and the work cancelled) to keep the tasklet from
+ * queuing.  It's cleared once the step is done or the blocking context has
+ * reset the beacon state.
+ */
+
 /**
  * struct mt7601u_dev - adapter structure
- * @lock:		protects @wcid->tx_rate.
  * @mac_lock:		locks out mac80211's tx status and rx paths.
- * @tx_lock:		protects @tx_q and changes of MT7601U_STATE_*_STATS
- *			flags in @state.
  * @rx_lock:		protects @rx_q.
- * @con_mon_lock:	protects @ap_bssid, @bcn_*, @avg_rssi.
+ * @con_mon_seq:	protects @ap_bssid, the RX tasklet reads it locklessly.
+ *			The RX tasklet is the only writer of @avg_rssi and
+ *			the beacon state in @freq_cal, other contexts ask
+ *			it to reset them through @con_mon_reset.
  * @mutex:		ensures exclusive access from mac80211 callbacks.
  * @vendor_req_mutex:	protects @vend_buf, ensures atomicity of split writes.
  * @reg_atomic_mutex:	ensures atomicity of indirect register accesses
@@ -169,6 +908,12 @@ struct mt7601u_dev {
 	struct mt7601u_mcu mcu;
 
 	struct delayed_work cal_work;
+	struct mt7601u_cal_state cal;
+	struct mt7601u_cal_cache cal_cache;
+	struct mt7601u_reg_shadow shadow;
+	struct mt7601u_chan_prog *chan_prog;
+	struct mt7601u_chsw_stats chsw;
+	struct mt7601u_scan scan;
 	struct delayed_work mac_work;
 
 	struct workqueue_struct *stat_wq;
@@ -177,7 +922,6 @@ struct mt7601u_dev {
 	struct mt76_wcid *mon_wcid;
 	struct mt76_wcid __rcu *wcid[N_WCIDS];
 
-	spinlock_t lock;
 	spinlock_t mac_lock;
 
 	const u16 *beacon_offsets;
@@ -186,6 +930,7 @@ struct mt7601u_dev {
 	struct mt7601u_eeprom_params *ee;
 
 	struct mutex vendor_req_mutex;
+	atomic_t usb_xfers;
 	void *vend_buf;
 
 	struct mutex reg_atomic_mutex;
@@ -200,24 +945,44 @@ struct mt7601u_dev {
 	u16 in_max_packet;
 
 	/* TX */
-	spinlock_t tx_lock;
 	struct tasklet_struct tx_tasklet;
 	struct mt7601u_tx_queue *tx_q;
+	u32 tx_ring_size[IEEE80211_NUM_ACS];
+	u32 tx_wake_div;
 	struct sk_buff_head tx_skb_done;
+	struct mt7601u_tx_batch_stats tx_batch;
+	struct mt7601u_tx_slow_path tx_slow_path;
+	struct mt7601u_csum_stats tx_csum;
+
+	wait_queue_head_t tx_flush_wq;
+	struct mt7601u_flush_stats flush_stats;
+
+	atomic_t tx_pending;
+	struct mt7601u_tx_status_stats tx_status_stats;
+	struct mt7601u_tx_stat_poll tx_stat_poll;
+	struct mt7601u_tx_lat_stats tx_lat;
+
+	struct mt7601u_pktgen pktgen;
 
 	atomic_t avg_ampdu_len;
+	struct mt7601u_mrr mrr;
+	struct mt7601u_ampdu_tune ampdu;
+	struct mt7601u_tx_burst burst;
+	struct mt7601u_prot_policy prot;
 
 	/* RX */
 	spinlock_t rx_lock;
 	struct tasklet_struct rx_tasklet;
 	struct mt7601u_rx_queue rx_q;
 
+	bool rx_csum;
+	struct mt7601u_csum_stats rx_csum_stats;
+	struct mt7601u_rx_cost rx_cost;
+
 	/* Connection monitoring things */
-	spinlock_t con_mon_lock;
+	seqcount_t con_mon_seq;
 	u8 ap_bssid[ETH_ALEN];
-
-	s8 bcn_freq_off;
-	u8 bcn_phy_mode;
+	unsigned long con_mon_reset;
 
 	int avg_rssi; /* starts at 0 and converges */
 
@@ -253,15 +1018,79 @@ struct mt7601u_tssi_params {
 	int trgt_power;
 };
 
+#define MT_WCID_TX_RATE_VAL	GENMASK(15, 0)
+#define MT_WCID_TX_RATE_NSS	GENMASK(23, 16)
+#define MT_WCID_TX_RATE_SET	BIT(31)
+
+/**
+ * struct mt76_wcid - HW station table entry
+ * @tx_rate:	fixed TX rate packed as MT_WCID_TX_RATE_* fields, written
+ *		and read as a whole with WRITE_ONCE()/READ_ONCE().
+ * @tx_pending:	frames which requested TX status and wait for their entry
+ *		in the TX_STAT_FIFO, oldest first.  Only valid for WCIDs
+ *		published in @dev->wcid.
+ * @pktid_seq:	source of rolling PKT_IDs of frames which requested status.
+ * @pktid_last:	last rolling PKT_ID seen in the TX_STAT_FIFO, 0 if none.
+ * @probe_rate:	requested rate of the outstanding rate control probe.
+ * @probe_sent:	jiffies when the outstanding probe was sent, 0 if none.
+ */
 struct mt76_wcid {
 	u8 idx;
 	u8 hw_key_idx;
+	u8 probe_rate;
+	u8 pktid_last;
+
+	u32 tx_rate;
+	atomic_t pktid_seq;
+	unsigned long probe_sent;
 
-	u16 tx_rate;
-	bool tx_rate_set;
-	u8 tx_rate_nss;
+	struct sk_buff_head tx_pending;
+};
+
+#define MT_TX_CB_DMA_FAIL	BIT(0)
+#define MT_TX_CB_HW_CSUM	BIT(1)
+#define MT_TX_CB_PKTGEN		BIT(2)
+#define MT_TX_CB_PROBE		BIT(3)
+
+/**
+ * struct mt7601u_tx_cb - driver data kept in skb's TX status area
+ * @pkt_len:	length of the 802.11 frame as handed to us by mac80211.
+ * @flags:	MT_TX_CB_* flags.
+ * @pktid:	PKT_ID from the TXWI, used to match TX_STAT_FIFO entries.
+ * @rate:	requested rate (MCS or legacy rate index).
+ * @wcid:	WCID the frame was sent with.
+ * @stamp:	time in us (see mt7601u_tx_stamp()) the frame entered its
+ *		current TX latency stage.  For frames on the pending list of
+ *		@wcid that's the time their URB completed.
+ *
+ * Lives in info->status.status_driver_data which overlaps parts of
+ * info->control, therefore it may only be written once the TX path is
+ * done looking at the control information.  Note that
+ * ieee80211_tx_info_clear_status() wipes it.
+ */
+struct mt7601u_tx_cb {
+	u16 pkt_len;
+	u8 flags;
+	u8 pktid;
+	u8 wcid;
+	u8 rate;
+	u32 stamp;
 };
 
+static inline struct mt7601u_tx_cb *mt7601u_tx_skb_cb(struct sk_buff *skb)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+
+	BUILD_BUG_ON(sizeof(struct mt7601u_tx_cb) >
+		     sizeof(info->status.status_driver_data));
+	return (void *)info->status.status_driver_data;
+}
+
+static inline u32 mt7601u_tx_stamp(void)
+{
+	return ktime_to_us(ktime_get());
+}
+
 struct mt76_vif {
 	u8 idx;
 
@@ -273,11 +1102,6 @@ struct mt76_sta {
 	u16 agg_ssn[IEEE80211_NUM_TIDS];
 };
 
-struct mt76_reg_pair {
-	u32 reg;
-	u32 value;
-};
-
 struct mt7601u_rxwi;
 
 extern const struct ieee80211_ops mt7601u_ops;
@@ -329,6 +1153,10 @@ static inline u32 mt76_clear(struct mt7601u_dev *dev, u32 offset, u32 val)
 
 int mt7601u_write_reg_pairs(struct mt7601u_dev *dev, u32 base,
 			    const struct mt76_reg_pair *data, int len);
+int mt7601u_read_reg_pairs(struct mt7601u_dev *dev, u32 base,
+			   struct mt76_reg_pair *data, int n);
+int mt7601u_rmw_regs(struct mt7601u_dev *dev, u32 base,
+		     const struct mt76_reg_rmw *data, int n);
 int mt7601u_burst_write_regs(struct mt7601u_dev *dev, u32 offset,
 			     const u32 *data, int n);
 void mt7601u_addr_wr(struct mt7601u_dev *dev, const u32 offset, const u8 *addr);
@@ -353,13 +1181,22 @@ void mt7601u_agc_restore(struct mt7601u_dev *dev);
 int mt7601u_phy_set_channel(struct mt7601u_dev *dev,
 			    struct cfg80211_chan_def *chandef);
 void mt7601u_phy_recalibrate_after_assoc(struct mt7601u_dev *dev);
+void mt7601u_phy_cal_restart(struct mt7601u_dev *dev);
+int mt7601u_phy_shadow_idx(u32 addr);
+u32 mt7601u_phy_shadow_addr(int idx);
+void mt7601u_phy_shadow_wr(struct mt7601u_dev *dev, u32 addr, u8 val);
+void mt7601u_phy_shadow_rmw(struct mt7601u_dev *dev, u32 addr, u8 mask, u8 val);
+void mt7601u_phy_shadow_reset(struct mt7601u_dev *dev);
 int mt7601u_phy_get_rssi(struct mt7601u_dev *dev,
 			 struct mt7601u_rxwi *rxwi, u16 rate);
 void mt7601u_phy_con_cal_onoff(struct mt7601u_dev *dev,
 			       struct ieee80211_bss_conf *info);
+void mt7601u_phy_freq_cal_bcn(struct mt7601u_dev *dev, s8 freq_off,
+			      u8 phy_mode);
 
 /* MAC */
 void mt7601u_mac_work(struct work_struct *work);
+void mt7601u_mac_mrr_work(struct work_struct *work);
 void mt7601u_mac_set_protection(struct mt7601u_dev *dev, bool legacy_prot,
 				int ht_mode);
 void mt7601u_mac_set_short_preamble(struct mt7601u_dev *dev, bool short_preamb);
@@ -373,8 +1210,35 @@ void mt7601u_tx(struct ieee80211_hw *hw, struct ieee80211_tx_control *control,
 		struct sk_buff *skb);
 int mt7601u_conf_tx(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
 		    u16 queue, const struct ieee80211_tx_queue_params *params);
-void mt7601u_tx_status(struct mt7601u_dev *dev, struct sk_buff *skb);
+void mt7601u_tx_status(struct mt7601u_dev *dev, struct sk_buff_head *skbs);
 void mt7601u_tx_stat(struct work_struct *work);
+struct sk_buff *mt7601u_tx_pending_get(struct mt7601u_dev *dev,
+				       struct mt76_wcid *wcid, u8 pktid);
+void mt7601u_tx_pending_purge(struct mt7601u_dev *dev, struct mt76_wcid *wcid);
+void mt7601u_flush(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
+		   u32 queues, bool drop);
+void mt7601u_tx_lat_update(struct mt7601u_dev *dev, struct sk_buff *skb,
+			   enum mt7601u_tx_lat_stage stage);
+void mt7601u_tx_burst_update(struct mt7601u_dev *dev);
+void mt7601u_tx_burst_reset(struct mt7601u_dev *dev);
+int mt7601u_tx_pktgen(struct mt7601u_dev *dev, struct sk_buff *skb,
+		      struct mt76_wcid *wcid, u16 rate_ctl, u8 ac);
+u32 mt7601u_tx_queue_used(struct mt7601u_dev *dev, u8 ac, u32 *entries);
+
+/* pktgen */
+void mt7601u_pktgen_init(struct mt7601u_dev *dev);
+void mt7601u_pktgen_init_debugfs(struct mt7601u_dev *dev,
+				 struct dentry *parent);
+void mt7601u_pktgen_stop(struct mt7601u_dev *dev);
+void mt7601u_pktgen_tx_done(struct mt7601u_dev *dev, struct sk_buff *skb);
+int mt7601u_pktgen_mock_submit(struct mt7601u_dev *dev, struct urb *urb);
+
+/* scan */
+void mt7601u_scan_init(struct mt7601u_dev *dev);
+void mt7601u_scan_init_debugfs(struct mt7601u_dev *dev, struct dentry *parent);
+int mt7601u_hw_scan(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
+		    struct ieee80211_scan_request *hw_req);
+void mt7601u_cancel_hw_scan(struct ieee80211_hw *hw, struct ieee80211_vif *vif);
 
 /* util */
 void mt76_remove_hdr_pad(struct sk_buff *skb);
@@ -389,8 +1253,14 @@ static inline u32 mt7601u_mac_set_ctrlch(struct mt7601u_dev *dev, bool below)
 
 int mt7601u_dma_init(struct mt7601u_dev *dev);
 void mt7601u_dma_cleanup(struct mt7601u_dev *dev);
+int mt7601u_dma_resize_tx(struct mt7601u_dev *dev);
 
 int mt7601u_dma_enqueue_tx(struct mt7601u_dev *dev, struct sk_buff *skb,
 			   struct mt76_wcid *wcid, int hw_q);
+int mt7601u_dma_flush_tx(struct mt7601u_dev *dev, u32 hw_qs, bool drop,
+			 unsigned long timeout);
+u32 mt7601u_dma_tx_used(struct mt7601u_dev *dev, int hw_q, u32 *entries);
+void mt7601u_dma_tx_stats(struct mt7601u_dev *dev, int ep,
+			  struct mt7601u_tx_queue_stats *st, u32 *used);
 
 #endif
@@ -23,6 +23,114 @@
 
 static void mt7601u_agc_reset(struct mt7601u_dev *dev);
 
+/* Registers changed by the HW itself, never served from the shadow */
+static bool mt7601u_bbp_volatile(u8 offset)
+{
+	switch (offset) {
+	case MT_BBP_REG_VERSION:
+	case 21: /* soft reset */
+	case 22: /* TSSI measurement trigger */
+	case 47: /* TSSI/temperature read-out control and status */
+	case 49: /* TSSI/temperature value */
+	case 159: /* RXDC calibration status */
+	case 244: /* TSSI measurement trigger */
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool mt7601u_rf_volatile(u8 bank, u8 offset)
+{
+	/* VCO calibration trigger bit clears itself */
+	return bank == 0 && offset == 4;
+}
+
+/* Map MCU memmap address of a BBP/RF register to shadow index */
+int mt7601u_phy_shadow_idx(u32 addr)
+{
+	u32 bank = (addr >> 16) & 0xff, offset = addr & 0xffff;
+
+	if (addr & MT_MCU_MEMMAP_RF) {
+		if (bank >= MT_SHADOW_RF_BANKS || offset >= MT_SHADOW_RF_REGS ||
+		    mt7601u_rf_volatile(bank, offset))
+			return -1;
+
+		return MT_SHADOW_BBP_REGS + bank * MT_SHADOW_RF_REGS + offset;
+	}
+
+	if (addr & MT_MCU_MEMMAP_BBP) {
+		if (bank || offset >= MT_SHADOW_BBP_REGS ||
+		    mt7601u_bbp_volatile(offset))
+			return -1;
+
+		return offset;
+	}
+
+	return -1;
+}
+
+u32 mt7601u_phy_shadow_addr(int idx)
+{
+	if (idx < MT_SHADOW_BBP_REGS)
+		return MT_MCU_MEMMAP_BBP | idx;
+
+	idx -= MT_SHADOW_BBP_REGS;
+	return MT_MCU_MEMMAP_RF | (idx / MT_SHADOW_RF_REGS) << 16 |
+		idx % MT_SHADOW_RF_REGS;
+}
+
+void mt7601u_phy_shadow_wr(struct mt7601u_dev *dev, u32 addr, u8 val)
+{
+	int idx = mt7601u_phy_shadow_idx(addr);
+
+	if (idx < 0)
+		return;
+
+	dev->shadow.val[idx] = val;
+	set_bit(idx, dev->shadow.valid);
+}
+
+void mt7601u_phy_shadow_rmw(struct mt7601u_dev *dev, u32 addr, u8 mask, u8 val)
+{
+	int idx = mt7601u_phy_shadow_idx(addr);
+
+	if (idx < 0)
+		return;
+
+	if (mask == 0xff)
+		mt7601u_phy_shadow_wr(dev, addr, val);
+	else if (test_bit(idx, dev->shadow.valid))
+		dev->shadow.val[idx] = (dev->shadow.val[idx] & ~mask) | val;
+}
+
+void mt7601u_phy_shadow_reset(struct mt7601u_dev *dev)
+{
+	bitmap_zero(dev->shadow.valid, MT_SHADOW_SIZE);
+}
+
+static bool mt7601u_phy_shadow_rr(struct mt7601u_dev *dev, u32 addr, u8 *val)
+{
+	int idx = mt7601u_phy_shadow_idx(addr);
+
+	if (idx < 0)
+		return false;
+
+	if (!test_bit(idx, dev->shadow.valid)) {
+		dev->shadow.misses++;
+		return false;
+	}
+
+	*val = dev->shadow.val[idx];
+	dev->shadow.hits++;
+	return true;
+}
+
+#define MT_RF_ADDR(bank, offset) \
+	(MT_MCU_MEMMAP_RF | (bank) << 16 | (offset))
+#define MT_BBP_ADDR(offset) \
+	(MT_MCU_MEMMAP_BBP | (offset))
+
 static int
 mt7601u_rf_wr(struct mt7601u_dev *dev, u8 bank, u8 offset, u8 value)
 {
@@ -46,6 +154,7 @@ mt7601u_rf_wr(struct mt7601u_dev *dev, u8 bank, u8 offset, u8 value)
 				       MT76_SET(MT_RF_CSR_CFG_REG_ID, offset) |
 				       MT_RF_CSR_CFG_WR |
 				       MT_RF_CSR_CFG_KICK);
+	mt7601u_phy_shadow_wr(dev, MT_RF_ADDR(bank, offset), value);
 	trace_rf_write(dev, bank, offset, value);
 out:
 	mutex_unlock(&dev->reg_atomic_mutex);
@@ -62,6 +171,7 @@ mt7601u_rf_rr(struct mt7601u_dev *dev, u8 bank, u8 offset)
 {
 	int ret = -ETIMEDOUT;
 	u32 val;
+	u8 cached;
 
 	if (WARN_ON(!test_bit(MT7601U_STATE_WLAN_RUNNING, &dev->state)) ||
 	    WARN_ON(offset > 63))
@@ -71,6 +181,11 @@ mt7601u_rf_rr(struct mt7601u_dev *dev, u8 bank, u8 offset)
 
 	mutex_lock(&dev->reg_atomic_mutex);
 
+	if (mt7601u_phy_shadow_rr(dev, MT_RF_ADDR(bank, offset), &cached)) {
+		ret = cached;
+		goto out;
+	}
+
 	if (!mt76_poll(dev, MT_RF_CSR_CFG, MT_RF_CSR_CFG_KICK, 0, 100))
 		goto out;
 
@@ -85,6 +200,7 @@ mt7601u_rf_rr(struct mt7601u_dev *dev, u8 bank, u8 offset)
 	if (MT76_GET(MT_RF_CSR_CFG_REG_ID, val) == offset &&
 	    MT76_GET(MT_RF_CSR_CFG_REG_BANK, val) == bank) {
 		ret = MT76_GET(MT_RF_CSR_CFG_DATA, val);
+		mt7601u_phy_shadow_wr(dev, MT_RF_ADDR(bank, offset), ret);
 		trace_rf_read(dev, bank, offset, ret);
 	}
 out:
@@ -97,34 +213,6 @@ out:
 	return ret;
 }
 
-static int
-mt7601u_rf_rmw(struct mt7601u_dev *dev, u8 bank, u8 offset, u8 mask, u8 val)
-{
-	int ret;
-
-	ret = mt7601u_rf_rr(dev, bank, offset);
-	if (ret < 0)
-		return ret;
-	val |= ret & ~mask;
-	ret = mt7601u_rf_wr(dev, bank, offset, val);
-	if (ret)
-		return ret;
-
-	return val;
-}
-
-static int
-mt7601u_rf_set(struct mt7601u_dev *dev, u8 bank, u8 offset, u8 val)
-{
-	return mt7601u_rf_rmw(dev, bank, offset, 0, val);
-}
-
-static int
-mt7601u_rf_clear(struct mt7601u_dev *dev, u8 bank, u8 offset, u8 mask)
-{
-	return mt7601u_rf_rmw(dev, bank, offset, mask, 0);
-}
-
 static void mt7601u_bbp_wr(struct mt7601u_dev *dev, u8 offset, u8 val)
 {
 	if (WARN_ON(!test_bit(MT7601U_STATE_WLAN_RUNNING, &dev->state)) ||
@@ -142,6 +230,7 @@ static void mt7601u_bbp_wr(struct mt7601u_dev *dev, u8 offset, u8 val)
 		   MT76_SET(MT_BBP_CSR_CFG_VAL, val) |
 		   MT76_SET(MT_BBP_CSR_CFG_REG_NUM, offset) |
 		   MT_BBP_CSR_CFG_RW_MODE | MT_BBP_CSR_CFG_BUSY);
+	mt7601u_phy_shadow_wr(dev, MT_BBP_ADDR(offset), val);
 	trace_bbp_write(dev, offset, val);
 out:
 	mutex_unlock(&dev->reg_atomic_mutex);
@@ -151,6 +240,7 @@ static int mt7601u_bbp_rr(struct mt7601u_dev *dev, u8 offset)
 {
 	u32 val;
 	int ret = -ETIMEDOUT;
+	u8 cached;
 
 	if (WARN_ON(!test_bit(MT7601U_STATE_WLAN_RUNNING, &dev->state)))
 		return -EINVAL;
@@ -159,6 +249,11 @@ static int mt7601u_bbp_rr(struct mt7601u_dev *dev, u8 offset)
 
 	mutex_lock(&dev->reg_atomic_mutex);
 
+	if (mt7601u_phy_shadow_rr(dev, MT_BBP_ADDR(offset), &cached)) {
+		ret = cached;
+		goto out;
+	}
+
 	if (!mt76_poll(dev, MT_BBP_CSR_CFG, MT_BBP_CSR_CFG_BUSY, 0, 1000))
 		goto out;
 
@@ -173,6 +268,7 @@ static int mt7601u_bbp_rr(struct mt7601u_dev *dev, u8 offset)
 	val = mt7601u_rr(dev, MT_BBP_CSR_CFG);
 	if (MT76_GET(MT_BBP_CSR_CFG_REG_NUM, val) == offset) {
 		ret = MT76_GET(MT_BBP_CSR_CFG_VAL, val);
+		mt7601u_phy_shadow_wr(dev, MT_BBP_ADDR(offset), ret);
 		trace_bbp_read(dev, offset, ret);
 	}
 out:
@@ -266,11 +362,15 @@ int mt7601u_phy_get_rssi(struct mt7601u_dev *dev,
 	return val;
 }
 
+static const struct mt76_reg_rmw vco_cal[] = {
+	RF_REG_RMW(0, 4, 0xff, 0x0a),
+	RF_REG_RMW(0, 5, 0xff, 0x20),
+	RF_REG_RMW(0, 4, 0, BIT(7)),
+};
+
 static void mt7601u_vco_cal(struct mt7601u_dev *dev)
 {
-	mt7601u_rf_wr(dev, 0, 4, 0x0a);
-	mt7601u_rf_wr(dev, 0, 5, 0x20);
-	mt7601u_rf_set(dev, 0, 4, BIT(7));
+	mt7601u_rmw_regs(dev, 0, vco_cal, ARRAY_SIZE(vco_cal));
 	msleep(2);
 }
 
@@ -325,59 +425,139 @@ static int mt7601u_bbp_temp(struct mt7601u_dev *dev, int mode, const char *name)
 				       t[dev->bw].regs, t[dev->bw].n);
 }
 
-static void mt7601u_apply_ch14_fixup(struct mt7601u_dev *dev, int hw_chan)
+#define FREQ_PLAN_REGS	4
+static const u8 freq_plan[14][FREQ_PLAN_REGS] = {
+	{ 0x99,	0x99,	0x09,	0x50 },
+	{ 0x46,	0x44,	0x0a,	0x50 },
+	{ 0xec,	0xee,	0x0a,	0x50 },
+	{ 0x99,	0x99,	0x0b,	0x50 },
+	{ 0x46,	0x44,	0x08,	0x51 },
+	{ 0xec,	0xee,	0x08,	0x51 },
+	{ 0x99,	0x99,	0x09,	0x51 },
+	{ 0x46,	0x44,	0x0a,	0x51 },
+	{ 0xec,	0xee,	0x0a,	0x51 },
+	{ 0x99,	0x99,	0x0b,	0x51 },
+	{ 0x46,	0x44,	0x08,	0x52 },
+	{ 0xec,	0xee,	0x08,	0x52 },
+	{ 0x99,	0x99,	0x09,	0x52 },
+	{ 0x33,	0x33,	0x0b,	0x52 },
+};
+
+static int mt7601u_chan_center_idx(int chan_idx, int bw, bool below)
 {
-	struct mt7601u_rate_power *t = &dev->ee->power_rate_table;
+	if (bw != MT_BW_40)
+		return chan_idx;
+
+	if (chan_idx > 1 && below)
+		return chan_idx - 2;
+	if (chan_idx < 12 && !below)
+		return chan_idx + 2;
 
-	if (hw_chan != 14 || dev->bw != MT_BW_20) {
-		mt7601u_bbp_rmw(dev, 4, 0x20, 0);
-		mt7601u_bbp_wr(dev, 178, 0xff);
+	return -1;
+}
+
+static struct mt7601u_chan_prog *
+mt7601u_chan_prog_get(struct mt7601u_dev *dev, int chan_idx, int bw, bool below)
+{
+	return &dev->chan_prog[(chan_idx * 2 + bw) * 2 + below];
+}
 
-		t->cck[0].bw20 = dev->ee->real_cck_bw20[0];
-		t->cck[1].bw20 = dev->ee->real_cck_bw20[1];
-	} else { /* Apply CH14 OBW fixup */
-		mt7601u_bbp_wr(dev, 4, 0x60);
-		mt7601u_bbp_wr(dev, 178, 0);
+static void
+mt7601u_chan_prog_set(struct mt76_reg_rmw *r, u32 reg, u32 mask, u32 value)
+{
+	r->reg = reg;
+	r->mask = mask;
+	r->value = value;
+}
 
-		/* Note: vendor code is buggy here for negative values */
-		t->cck[0].bw20 = dev->ee->real_cck_bw20[0] - 2;
-		t->cck[1].bw20 = dev->ee->real_cck_bw20[1] - 2;
+static void mt7601u_chan_prog_build(struct mt7601u_dev *dev,
+				    struct mt7601u_chan_prog *p,
+				    int chan_idx, int bw, bool below)
+{
+	struct mt7601u_rate_power *t = &dev->ee->power_rate_table;
+	int center = mt7601u_chan_center_idx(chan_idx, bw, below);
+	struct mt76_reg_rmw *r = p->pre;
+	u8 lna = 0x37 - dev->ee->lna_gain;
+	s8 cck[2];
+	int i;
+
+	/* Invalid 40MHz channel, switch will complain and use primary */
+	if (center < 0)
+		center = chan_idx;
+
+	for (i = 0; i < FREQ_PLAN_REGS; i++)
+		mt7601u_chan_prog_set(r++, MT_RF_ADDR(0, 17 + i), 0xff,
+				      freq_plan[center][i]);
+	for (i = 62; i <= 64; i++)
+		mt7601u_chan_prog_set(r++, MT_BBP_ADDR(i), 0xff, lna);
+	mt7601u_chan_prog_set(r++, MT_MCU_MEMMAP_WLAN + MT_TX_ALC_CFG_0,
+			      0x3f3f, dev->ee->chan_pwr[center] & 0x3f);
+	mt7601u_chan_prog_set(r++, MT_BBP_ADDR(3), 0x20, below ? 0x20 : 0);
+	mt7601u_chan_prog_set(r++, MT_MCU_MEMMAP_WLAN + MT_TX_BAND_CFG,
+			      MT_TX_BAND_CFG_UPPER_40M, below);
+	mt7601u_chan_prog_set(r++, MT_BBP_ADDR(4), 0x18,
+			      bw == MT_BW_20 ? 0 : 0x10);
+	for (i = 0; i < ARRAY_SIZE(vco_cal); i++)
+		*r++ = vco_cal[i];
+	BUILD_BUG_ON(FREQ_PLAN_REGS + 3 + 4 + ARRAY_SIZE(vco_cal) !=
+		     MT_CHAN_PROG_PRE);
+
+	/* CH14 OBW fixup */
+	p->ch14_fixup = chan_idx == 13 && bw == MT_BW_20;
+	for (i = 0; i < 2; i++)
+		cck[i] = dev->ee->real_cck_bw20[i] - (p->ch14_fixup ? 2 : 0);
+
+	r = p->post;
+	if (p->ch14_fixup) {
+		mt7601u_chan_prog_set(r++, MT_BBP_ADDR(4), 0xff, 0x60);
+		mt7601u_chan_prog_set(r++, MT_BBP_ADDR(178), 0xff, 0);
+	} else {
+		mt7601u_chan_prog_set(r++, MT_BBP_ADDR(4), 0x20, 0);
+		mt7601u_chan_prog_set(r++, MT_BBP_ADDR(178), 0xff, 0xff);
 	}
+	/* Note: vendor code is buggy here for negative values */
+	mt7601u_chan_prog_set(r++, MT_MCU_MEMMAP_WLAN + MT_TX_PWR_CFG_0, ~0,
+			      int_to_s6(t->ofdm[1].bw20) << 24 |
+			      int_to_s6(t->ofdm[0].bw20) << 16 |
+			      int_to_s6(cck[1]) << 8 |
+			      int_to_s6(cck[0]));
+	BUILD_BUG_ON(3 != MT_CHAN_PROG_POST);
+}
+
+/* Everything a channel switch writes depends only on the channel tuple and
+ * EEPROM contents, so build all the programs once and send each switch as
+ * two inband batches around the BW filter calibration.
+ */
+static int mt7601u_chan_prog_init(struct mt7601u_dev *dev)
+{
+	int chan_idx, bw, below;
+
+	if (!dev->chan_prog)
+		dev->chan_prog = devm_kcalloc(dev->dev, MT_CHAN_PROG_N,
+					      sizeof(*dev->chan_prog),
+					      GFP_KERNEL);
+	if (!dev->chan_prog)
+		return -ENOMEM;
+
+	for (chan_idx = 0; chan_idx < 14; chan_idx++)
+		for (bw = MT_BW_20; bw <= MT_BW_40; bw++)
+			for (below = 0; below < 2; below++)
+				mt7601u_chan_prog_build(dev,
+					mt7601u_chan_prog_get(dev, chan_idx,
+							      bw, below),
+					chan_idx, bw, below);
+
+	return 0;
 }
 
 static int __mt7601u_phy_set_channel(struct mt7601u_dev *dev,
 				     struct cfg80211_chan_def *chandef)
 {
-#define FREQ_PLAN_REGS	4
-	static const u8 freq_plan[14][FREQ_PLAN_REGS] = {
-		{ 0x99,	0x99,	0x09,	0x50 },
-		{ 0x46,	0x44,	0x0a,	0x50 },
-		{ 0xec,	0xee,	0x0a,	0x50 },
-		{ 0x99,	0x99,	0x0b,	0x50 },
-		{ 0x46,	0x44,	0x08,	0x51 },
-		{ 0xec,	0xee,	0x08,	0x51 },
-		{ 0x99,	0x99,	0x09,	0x51 },
-		{ 0x46,	0x44,	0x0a,	0x51 },
-		{ 0xec,	0xee,	0x0a,	0x51 },
-		{ 0x99,	0x99,	0x0b,	0x51 },
-		{ 0x46,	0x44,	0x08,	0x52 },
-		{ 0xec,	0xee,	0x08,	0x52 },
-		{ 0x99,	0x99,	0x09,	0x52 },
-		{ 0x33,	0x33,	0x0b,	0x52 },
-	};
-	struct mt76_reg_pair channel_freq_plan[FREQ_PLAN_REGS] = {
-		{ 17, 0 }, { 18, 0 }, { 19, 0 }, { 20, 0 },
-	};
-	struct mt76_reg_pair bbp_settings[3] = {
-		{ 62, 0x37 - dev->ee->lna_gain },
-		{ 63, 0x37 - dev->ee->lna_gain },
-		{ 64, 0x37 - dev->ee->lna_gain },
-	};
-
 	struct ieee80211_channel *chan = chandef->chan;
 	enum nl80211_channel_type chan_type =
 		cfg80211_get_chandef_type(chandef);
 	struct mt7601u_rate_power *t = &dev->ee->power_rate_table;
+	struct mt7601u_chan_prog *prog;
 	int chan_idx;
 	bool chan_ext_below;
 	u8 bw;
@@ -390,11 +570,7 @@ static int __mt7601u_phy_set_channel(struct mt7601u_dev *dev,
 	if (chandef->width == NL80211_CHAN_WIDTH_40) {
 		bw = MT_BW_40;
 
-		if (chan_idx > 1 && chan_type == NL80211_CHAN_HT40MINUS)
-			chan_idx -= 2;
-		else if (chan_idx < 12 && chan_type == NL80211_CHAN_HT40PLUS)
-			chan_idx += 2;
-		else
+		if (mt7601u_chan_center_idx(chan_idx, bw, chan_ext_below) < 0)
 			dev_err(dev->dev, "Error: invalid 40MHz channel!!\n");
 	}
 
@@ -402,40 +578,30 @@ static int __mt7601u_phy_set_channel(struct mt7601u_dev *dev,
 		dev_dbg(dev->dev, "Info: switching HT mode bw:%d below:%d\n",
 			bw, chan_ext_below);
 
+		/* Stops MAC and reloads BBP tables, ctrl chan is in prog */
 		mt7601u_bbp_set_bw(dev, bw);
-
-		mt7601u_bbp_set_ctrlch(dev, chan_ext_below);
-		mt7601u_mac_set_ctrlch(dev, chan_ext_below);
 		dev->chan_ext_below = chan_ext_below;
 	}
 
-	for (i = 0; i < FREQ_PLAN_REGS; i++)
-		channel_freq_plan[i].value = freq_plan[chan_idx][i];
+	prog = mt7601u_chan_prog_get(dev, chan_idx, bw, chan_ext_below);
 
-	ret = mt7601u_write_reg_pairs(dev, MT_MCU_MEMMAP_RF,
-				      channel_freq_plan, FREQ_PLAN_REGS);
+	ret = mt7601u_rmw_regs(dev, 0, prog->pre, MT_CHAN_PROG_PRE);
 	if (ret)
 		return ret;
+	msleep(2); /* VCO calibration */
 
-	mt7601u_rmw(dev, MT_TX_ALC_CFG_0, 0x3f3f,
-		    dev->ee->chan_pwr[chan_idx] & 0x3f);
-
-	ret = mt7601u_write_reg_pairs(dev, MT_MCU_MEMMAP_BBP,
-				      bbp_settings, ARRAY_SIZE(bbp_settings));
+	ret = mt7601u_set_bw_filter(dev, false);
 	if (ret)
 		return ret;
 
-	mt7601u_vco_cal(dev);
-	mt7601u_bbp_set_bw(dev, bw);
-	ret = mt7601u_set_bw_filter(dev, false);
+	ret = mt7601u_rmw_regs(dev, 0, prog->post, MT_CHAN_PROG_POST);
 	if (ret)
 		return ret;
 
-	mt7601u_apply_ch14_fixup(dev, chan->hw_value);
-	mt7601u_wr(dev, MT_TX_PWR_CFG_0, int_to_s6(t->ofdm[1].bw20) << 24 |
-					 int_to_s6(t->ofdm[0].bw20) << 16 |
-					 int_to_s6(t->cck[1].bw20) << 8 |
-					 int_to_s6(t->cck[0].bw20));
+	/* TSSI uses the CCK power table, keep it in sync with the HW */
+	for (i = 0; i < 2; i++)
+		t->cck[i].bw20 = dev->ee->real_cck_bw20[i] -
+				 (prog->ch14_fixup ? 2 : 0);
 
 	if (test_bit(MT7601U_STATE_SCANNING, &dev->state))
 		mt7601u_agc_reset(dev);
@@ -445,13 +611,58 @@ static int __mt7601u_phy_set_channel(struct mt7601u_dev *dev,
 	return 0;
 }
 
+/* Allow queuing the next correction step again */
+static void mt7601u_freq_cal_unblock(struct mt7601u_dev *dev)
+{
+	smp_mb__before_atomic();
+	clear_bit(MT7601U_STATE_FREQ_CAL, &dev->state);
+}
+
+/* Ask RX to drop beacon history, ignore beacons for @delay and allow
+ * queuing the next correction step.  Must not race with freq_cal.work.
+ */
+static void mt7601u_freq_cal_reset(struct mt7601u_dev *dev,
+				   unsigned long delay, bool stop)
+{
+	WRITE_ONCE(dev->freq_cal.holdoff, jiffies + delay);
+	set_bit(MT_CON_MON_RESET_FREQ, &dev->con_mon_reset);
+	if (stop)
+		set_bit(MT_CON_MON_STOP_ADJ, &dev->con_mon_reset);
+
+	mt7601u_freq_cal_unblock(dev);
+}
+
+/* Stop the RX tasklet from queuing new correction steps and get rid of the
+ * one in flight, if any.  With the tasklet held off nothing can queue the
+ * work, so once it's cancelled we own the step bit whoever set it - even if
+ * mac80211 refused to queue the step (e.g. while quiescing) and no work
+ * would ever clear it.  mt7601u_freq_cal_reset() drops the bit.
+ */
+static void mt7601u_freq_cal_block(struct mt7601u_dev *dev)
+{
+	tasklet_disable(&dev->rx_tasklet);
+	cancel_work_sync(&dev->freq_cal.work);
+	set_bit(MT7601U_STATE_FREQ_CAL, &dev->state);
+	tasklet_enable(&dev->rx_tasklet);
+}
+
 int mt7601u_phy_set_channel(struct mt7601u_dev *dev,
 			    struct cfg80211_chan_def *chandef)
 {
+	ktime_t start = ktime_get();
+	u32 us;
 	int ret;
 
 	cancel_delayed_work_sync(&dev->cal_work);
-	cancel_delayed_work_sync(&dev->freq_cal.work);
+	mt7601u_freq_cal_block(dev);
+	/* Beacons are ignored while scanning, so there is nothing to flush on
+	 * scan hops and re-arming the holdoff would only delay freq cal on
+	 * the home channel after every hop.
+	 */
+	if (test_bit(MT7601U_STATE_SCANNING, &dev->state))
+		mt7601u_freq_cal_unblock(dev);
+	else
+		mt7601u_freq_cal_reset(dev, MT_FREQ_CAL_INIT_DELAY, false);
 
 	mutex_lock(&dev->hw_atomic_mutex);
 	ret = __mt7601u_phy_set_channel(dev, chandef);
@@ -459,14 +670,16 @@ int mt7601u_phy_set_channel(struct mt7601u_dev *dev,
 	if (ret)
 		return ret;
 
+	us = ktime_us_delta(ktime_get(), start);
+	dev->chsw.hist[min_t(u32, fls(us), MT_CHSW_LAT_HIST - 1)]++;
+	dev->chsw.last_us = us;
+	dev->chsw.max_us = max(dev->chsw.max_us, us);
+
 	if (test_bit(MT7601U_STATE_SCANNING, &dev->state))
 		return 0;
 
-	ieee80211_queue_delayed_work(dev->hw, &dev->cal_work,
-				     MT_CALIBRATE_INTERVAL);
-	if (dev->freq_cal.enabled)
-		ieee80211_queue_delayed_work(dev->hw, &dev->freq_cal.work,
-					     MT_FREQ_CAL_INIT_DELAY);
+	mt7601u_phy_cal_restart(dev);
+
 	return 0;
 }
 
@@ -558,7 +771,8 @@ static void mt7601u_rxdc_cal(struct mt7601u_dev *dev)
 		{ 158, 0x8c }, { 159, 0x4c },
 	}, outro[] = {
 		{ 158, 0x8d }, { 159, 0xe0 },
-	};
+	}, sel = { 158, 0x8c };
+	struct mt76_reg_pair res = { 159, 0 };
 	u32 mac_ctrl;
 	int i, ret;
 
@@ -573,8 +787,12 @@ static void mt7601u_rxdc_cal(struct mt7601u_dev *dev)
 	for (i = 20; i; i--) {
 		usleep_range(300, 500);
 
-		mt7601u_bbp_wr(dev, 158, 0x8c);
-		if (mt7601u_bbp_rr(dev, 159) == 0x0c)
+		ret = mt7601u_write_reg_pairs(dev, MT_MCU_MEMMAP_BBP,
+					      &sel, 1);
+		if (!ret)
+			ret = mt7601u_read_reg_pairs(dev, MT_MCU_MEMMAP_BBP,
+						     &res, 1);
+		if (!ret && (res.value & 0xff) == 0x0c)
 			break;
 	}
 	if (!i)
@@ -641,8 +859,91 @@ mt7601u_set_initial_tssi(struct mt7601u_dev *dev, s16 tssi_db, s16 tssi_hvga_db)
 		 int_to_s6(init_offset) & MT_TX_ALC_CFG_1_TEMP_COMP);
 }
 
+static int mt7601u_cal_cache_band(int temp)
+{
+	/* Round down so that all bands are equally wide */
+	if (temp < 0)
+		return -((-temp + MT_CAL_CACHE_TEMP_BAND - 1) /
+			 MT_CAL_CACHE_TEMP_BAND);
+	return temp / MT_CAL_CACHE_TEMP_BAND;
+}
+
+static struct mt7601u_cal_cache_entry *
+mt7601u_cal_cache_find(struct mt7601u_dev *dev)
+{
+	struct mt7601u_cal_cache *cc = &dev->cal_cache;
+	int i, band = mt7601u_cal_cache_band(dev->curr_temp);
+
+	/* Entries are only good for the adapter they were taken on, if the
+	 * eFuse has no valid MAC we get a random one and never match.
+	 */
+	if (!cc->enabled || !ether_addr_equal(cc->addr, dev->macaddr))
+		return NULL;
+
+	for (i = 0; i < MT_CAL_CACHE_SLOTS; i++)
+		if (cc->ent[i].valid && cc->ent[i].temp_band == band)
+			return &cc->ent[i];
+
+	return NULL;
+}
+
+static void
+mt7601u_cal_cache_store(struct mt7601u_dev *dev, s16 tssi_db, s16 tssi_hvga_db)
+{
+	struct mt7601u_cal_cache *cc = &dev->cal_cache;
+	struct mt7601u_cal_cache_entry *ent = &cc->ent[0];
+	int i, band = mt7601u_cal_cache_band(dev->curr_temp);
+
+	if (!ether_addr_equal(cc->addr, dev->macaddr)) {
+		memset(cc->ent, 0, sizeof(cc->ent));
+		ether_addr_copy(cc->addr, dev->macaddr);
+	}
+
+	/* Reuse the slot of this band, a free one or the least recently
+	 * used one, in that order.
+	 */
+	for (i = 0; i < MT_CAL_CACHE_SLOTS; i++) {
+		struct mt7601u_cal_cache_entry *e = &cc->ent[i];
+
+		if (e->valid && e->temp_band == band) {
+			ent = e;
+			break;
+		}
+		if (!ent->valid)
+			continue;
+		if (!e->valid || time_before(e->used, ent->used))
+			ent = e;
+	}
+
+	ent->valid = true;
+	ent->temp_band = band;
+	ent->used = jiffies;
+	ent->tssi_init = dev->tssi_init;
+	ent->tssi_init_hvga = dev->tssi_init_hvga;
+	ent->tssi_db = tssi_db;
+	ent->tssi_hvga_db = tssi_hvga_db;
+}
+
 static void mt7601u_tssi_dc_gain_cal(struct mt7601u_dev *dev)
 {
+	static const struct mt76_reg_pair bbp_setup[] = {
+		{ 58, 0 }, { 241, 0x2 }, { 23, 0x8 },
+	};
+	struct mt76_reg_pair bbp_save = { 47, 0 };
+	struct mt76_reg_pair rf_save[] = {
+		RF_REG_PAIR(5, 3, 0), /* VGA gain */
+		RF_REG_PAIR(4, 39, 0), /* Mixer */
+	};
+	struct mt76_reg_pair rf_cfg[] = {
+		RF_REG_PAIR(5, 3, 8),
+		RF_REG_PAIR(4, 39, 0),
+	};
+	struct mt76_reg_pair bbp_cfg[] = {
+		{ 23, 0 }, { 22, 0 }, { 244, 0 },
+	};
+	struct mt76_reg_pair bbp_meas[] = {
+		{ 47, 0x50 }, { 0, 0 },
+	};
 	u8 rf_vga, rf_mixer, bbp_r47;
 	int i, j;
 	s8 res[4];
@@ -652,36 +953,36 @@ static void mt7601u_tssi_dc_gain_cal(struct mt7601u_dev *dev)
 	mt7601u_wr(dev, MT_RF_BYPASS_0, 0x000c0030);
 	mt7601u_wr(dev, MT_MAC_SYS_CTRL, 0);
 
-	mt7601u_bbp_wr(dev, 58, 0);
-	mt7601u_bbp_wr(dev, 241, 0x2);
-	mt7601u_bbp_wr(dev, 23, 0x8);
-	bbp_r47 = mt7601u_bbp_rr(dev, 47);
+	mt7601u_write_reg_pairs(dev, MT_MCU_MEMMAP_BBP,
+				bbp_setup, ARRAY_SIZE(bbp_setup));
+	mt7601u_read_reg_pairs(dev, MT_MCU_MEMMAP_BBP, &bbp_save, 1);
+	bbp_r47 = bbp_save.value;
 
-	/* Set VGA gain */
-	rf_vga = mt7601u_rf_rr(dev, 5, 3);
-	mt7601u_rf_wr(dev, 5, 3, 8);
-
-	/* Mixer disable */
-	rf_mixer = mt7601u_rf_rr(dev, 4, 39);
-	mt7601u_rf_wr(dev, 4, 39, 0);
+	/* Set VGA gain and disable mixer */
+	mt7601u_read_reg_pairs(dev, 0, rf_save, ARRAY_SIZE(rf_save));
+	rf_vga = rf_save[0].value;
+	rf_mixer = rf_save[1].value;
+	mt7601u_write_reg_pairs(dev, 0, rf_cfg, ARRAY_SIZE(rf_cfg));
 
 	for (i = 0; i < 4; i++) {
-		mt7601u_rf_wr(dev, 4, 39, (i & 1) ? rf_mixer : 0);
-
-		mt7601u_bbp_wr(dev, 23, (i < 2) ? 0x08 : 0x02);
-		mt7601u_rf_wr(dev, 5, 3, (i < 2) ? 0x08 : 0x11);
+		rf_cfg[0].value = (i < 2) ? 0x08 : 0x11;
+		rf_cfg[1].value = (i & 1) ? rf_mixer : 0;
+		mt7601u_write_reg_pairs(dev, 0, rf_cfg, ARRAY_SIZE(rf_cfg));
 
 		/* BBP TSSI initial and soft reset */
-		mt7601u_bbp_wr(dev, 22, 0);
-		mt7601u_bbp_wr(dev, 244, 0);
+		bbp_cfg[0].value = (i < 2) ? 0x08 : 0x02;
+		mt7601u_write_reg_pairs(dev, MT_MCU_MEMMAP_BBP,
+					bbp_cfg, ARRAY_SIZE(bbp_cfg));
 
 		mt7601u_bbp_wr(dev, 21, 1);
 		udelay(1);
 		mt7601u_bbp_wr(dev, 21, 0);
 
 		/* TSSI measurement */
-		mt7601u_bbp_wr(dev, 47, 0x50);
-		mt7601u_bbp_wr(dev, (i & 1) ? 244 : 22, (i & 1) ? 0x31 : 0x40);
+		bbp_meas[1].reg = (i & 1) ? 244 : 22;
+		bbp_meas[1].value = (i & 1) ? 0x31 : 0x40;
+		mt7601u_write_reg_pairs(dev, MT_MCU_MEMMAP_BBP,
+					bbp_meas, ARRAY_SIZE(bbp_meas));
 
 		for (j = 20; j; j--)
 			if (!(mt7601u_bbp_rr(dev, 47) & 0x10))
@@ -705,8 +1006,7 @@ static void mt7601u_tssi_dc_gain_cal(struct mt7601u_dev *dev)
 		dev->tssi_init, tssi_init_db, dev->tssi_init_hvga,
 		tssi_init_hvga_db, dev->tssi_init_hvga_offset_db);
 
-	mt7601u_bbp_wr(dev, 22, 0);
-	mt7601u_bbp_wr(dev, 244, 0);
+	mt7601u_write_reg_pairs(dev, MT_MCU_MEMMAP_BBP, &bbp_cfg[1], 2);
 
 	mt7601u_bbp_wr(dev, 21, 1);
 	udelay(1);
@@ -715,15 +1015,44 @@ static void mt7601u_tssi_dc_gain_cal(struct mt7601u_dev *dev)
 	mt7601u_wr(dev, MT_RF_BYPASS_0, 0);
 	mt7601u_wr(dev, MT_RF_SETTING_0, 0);
 
-	mt7601u_rf_wr(dev, 5, 3, rf_vga);
-	mt7601u_rf_wr(dev, 4, 39, rf_mixer);
+	rf_cfg[0].value = rf_vga;
+	rf_cfg[1].value = rf_mixer;
+	mt7601u_write_reg_pairs(dev, 0, rf_cfg, ARRAY_SIZE(rf_cfg));
 	mt7601u_bbp_wr(dev, 47, bbp_r47);
 
 	mt7601u_set_initial_tssi(dev, tssi_init_db, tssi_init_hvga_db);
+	mt7601u_cal_cache_store(dev, tssi_init_db, tssi_init_hvga_db);
+}
+
+static void mt7601u_cal_cache_replay(struct mt7601u_dev *dev,
+				     struct mt7601u_cal_cache_entry *ent)
+{
+	/* BBP state mt7601u_tssi_dc_gain_cal() leaves behind */
+	static const struct mt76_reg_pair bbp_final[] = {
+		{ 58, 0 }, { 241, 0x2 }, { 23, 0x2 }, { 22, 0 }, { 244, 0 },
+	};
+
+	mt7601u_write_reg_pairs(dev, MT_MCU_MEMMAP_BBP,
+				bbp_final, ARRAY_SIZE(bbp_final));
+
+	dev->tssi_init = ent->tssi_init;
+	dev->tssi_init_hvga = ent->tssi_init_hvga;
+	dev->tssi_init_hvga_offset_db = ent->tssi_hvga_db - ent->tssi_db;
+
+	mt7601u_set_initial_tssi(dev, ent->tssi_db, ent->tssi_hvga_db);
+
+	ent->used = jiffies;
 }
 
 static int mt7601u_temp_comp(struct mt7601u_dev *dev, bool on)
 {
+	static const struct mt76_reg_rmw pll_protect_on[] = {
+		RF_REG_RMW(4, 4, 0xff, 6),
+		RF_REG_RMW(4, 10, 0x30, 0),
+	}, pll_protect_off[] = {
+		RF_REG_RMW(4, 4, 0xff, 0),
+		RF_REG_RMW(4, 10, 0x30, 0x10),
+	};
 	int ret, temp, hi_temp = 400, lo_temp = -200;
 
 	temp = (dev->raw_temp - dev->ee->ref_temp) * MT_EE_TEMPERATURE_SLOPE;
@@ -746,15 +1075,15 @@ static int mt7601u_temp_comp(struct mt7601u_dev *dev, bool on)
 	if (temp < -50 && !dev->pll_lock_protect) { /* < 20C */
 		dev->pll_lock_protect =  true;
 
-		mt7601u_rf_wr(dev, 4, 4, 6);
-		mt7601u_rf_clear(dev, 4, 10, 0x30);
+		mt7601u_rmw_regs(dev, 0, pll_protect_on,
+				 ARRAY_SIZE(pll_protect_on));
 
 		dev_dbg(dev->dev, "PLL lock protect on - too cold\n");
 	} else if (temp > 50 && dev->pll_lock_protect) { /* > 30C */
 		dev->pll_lock_protect = false;
 
-		mt7601u_rf_wr(dev, 4, 4, 0);
-		mt7601u_rf_rmw(dev, 4, 10, 0x30, 0x10);
+		mt7601u_rmw_regs(dev, 0, pll_protect_off,
+				 ARRAY_SIZE(pll_protect_off));
 
 		dev_dbg(dev->dev, "PLL lock protect off\n");
 	}
@@ -937,6 +1266,7 @@ static int mt7601u_tssi_cal(struct mt7601u_dev *dev)
 	diff_pwr /= 4096;
 
 	dev_dbg(dev->dev, "final diff: %08x\n", diff_pwr);
+	dev->cal.tssi_settled = !diff_pwr;
 
 	val = mt7601u_rr(dev, MT_TX_ALC_CFG_1);
 	curr_pwr = s6_to_int(MT76_GET(MT_TX_ALC_CFG_1_TEMP_COMP, val));
@@ -972,6 +1302,7 @@ void mt7601u_agc_restore(struct mt7601u_dev *dev)
 static void mt7601u_agc_tune(struct mt7601u_dev *dev)
 {
 	u8 val = mt7601u_agc_default(dev);
+	int rssi;
 
 	if (test_bit(MT7601U_STATE_SCANNING, &dev->state))
 		return;
@@ -980,12 +1311,11 @@ static void mt7601u_agc_tune(struct mt7601u_dev *dev)
 	 *	 there is enough rssi updates since last run?
 	 *	 Rssi updates are only on beacons and U2M so should work...
 	 */
-	spin_lock_bh(&dev->con_mon_lock);
-	if (dev->avg_rssi <= -70)
+	rssi = READ_ONCE(dev->avg_rssi);
+	if (rssi <= -70)
 		val -= 0x20;
-	else if (dev->avg_rssi <= -60)
+	else if (rssi <= -60)
 		val -= 0x10;
-	spin_unlock_bh(&dev->con_mon_lock);
 
 	if (val != mt7601u_bbp_rr(dev, 66))
 		mt7601u_bbp_wr(dev, 66, val);
@@ -995,132 +1325,220 @@ static void mt7601u_agc_tune(struct mt7601u_dev *dev)
 	 */
 }
 
+void mt7601u_phy_cal_restart(struct mt7601u_dev *dev)
+{
+	dev->cal.force = true;
+	dev->cal.interval = MT_CALIBRATE_INTERVAL;
+
+	ieee80211_queue_delayed_work(dev->hw, &dev->cal_work,
+				     MT_CALIBRATE_INTERVAL);
+}
+
+/* Each step runs only if its input moved since it last ran: AGC follows
+ * average RSSI, TSSI keeps running until it stops correcting TX power and
+ * temperature compensation follows temperature.  Temperature itself has
+ * to be read every time.  While nothing changes the period gets longer.
+ */
 static void mt7601u_phy_calibrate(struct work_struct *work)
 {
 	struct mt7601u_dev *dev = container_of(work, struct mt7601u_dev,
 					    cal_work.work);
+	struct mt7601u_cal_state *cal = &dev->cal;
+	int xfers = atomic_read(&dev->usb_xfers);
+	ktime_t start = ktime_get();
+	bool idle = true;
+	int rssi;
+
+	/* Sum of rssi << 8 decaying by 1/16, i.e. dBm scaled by 4096 */
+	rssi = READ_ONCE(dev->avg_rssi) >> 12;
+
+	if (cal->force || abs(rssi - cal->agc_rssi) >= MT_CAL_RSSI_DELTA) {
+		mt7601u_agc_tune(dev);
+		cal->agc_rssi = rssi;
+		idle = false;
+	} else {
+		cal->skip_agc++;
+	}
 
-	mt7601u_agc_tune(dev);
-	mt7601u_tssi_cal(dev);
-	/* If TSSI calibration was run it already updated temperature. */
-	if (!dev->ee->tssi_enabled)
+	if (dev->ee->tssi_enabled && (cal->force || !cal->tssi_settled)) {
+		/* TSSI calibration updates temperature as a side effect */
+		mt7601u_tssi_cal(dev);
+		idle = false;
+	} else {
+		if (dev->ee->tssi_enabled)
+			cal->skip_tssi++;
 		dev->raw_temp = mt7601u_read_temp(dev);
-	mt7601u_temp_comp(dev, true); /* TODO: find right value for @on */
+	}
 
-	ieee80211_queue_delayed_work(dev->hw, &dev->cal_work,
-				     MT_CALIBRATE_INTERVAL);
-}
+	if (cal->force || abs(dev->raw_temp - cal->temp) >= MT_CAL_TEMP_DELTA) {
+		/* TODO: find right value for @on */
+		mt7601u_temp_comp(dev, true);
+		cal->temp = dev->raw_temp;
+		/* TX power drifts with temperature, recheck it */
+		cal->tssi_settled = false;
+		idle = false;
+	} else {
+		cal->skip_temp++;
+	}
 
-static unsigned long
-__mt7601u_phy_freq_cal(struct mt7601u_dev *dev, s8 last_offset, u8 phy_mode)
-{
-	u8 activate_threshold, deactivate_threshold;
+	cal->force = false;
+	if (idle)
+		cal->interval = min_t(unsigned long, cal->interval * 2,
+				      MT_CAL_INTERVAL_MAX);
+	else
+		cal->interval = MT_CALIBRATE_INTERVAL;
 
-	trace_freq_cal_offset(dev, phy_mode, last_offset);
+	cal->runs++;
+	cal->usb_xfers = atomic_read(&dev->usb_xfers) - xfers;
+	cal->usb_xfers_total += cal->usb_xfers;
+	cal->time_us = ktime_us_delta(ktime_get(), start);
+	cal->time_max_us = max(cal->time_max_us, cal->time_us);
+	cal->time_total_us += cal->time_us;
 
-	/* No beacons received - reschedule soon */
-	if (last_offset == MT_FREQ_OFFSET_INVALID)
-		return MT_FREQ_CAL_ADJ_INTERVAL;
+	ieee80211_queue_delayed_work(dev->hw, &dev->cal_work, cal->interval);
+}
 
+static bool
+mt7601u_freq_cal_thresholds(u8 phy_mode, u8 *activate, u8 *deactivate)
+{
 	switch (phy_mode) {
 	case MT_PHY_TYPE_CCK:
-		activate_threshold = 19;
-		deactivate_threshold = 5;
+		*activate = 19;
+		*deactivate = 5;
 		break;
 	case MT_PHY_TYPE_OFDM:
-		activate_threshold = 102;
-		deactivate_threshold = 32;
+		*activate = 102;
+		*deactivate = 32;
 		break;
 	case MT_PHY_TYPE_HT:
 	case MT_PHY_TYPE_HT_GF:
-		activate_threshold = 82;
-		deactivate_threshold = 20;
+		*activate = 82;
+		*deactivate = 20;
 		break;
 	default:
-		WARN_ON(1);
-		return MT_FREQ_CAL_CHECK_INTERVAL;
+		return false;
 	}
 
-	if (abs(last_offset) >= activate_threshold)
-		dev->freq_cal.adjusting = true;
-	else if (abs(last_offset) <= deactivate_threshold)
-		dev->freq_cal.adjusting = false;
+	return true;
+}
 
-	if (!dev->freq_cal.adjusting)
-		return MT_FREQ_CAL_CHECK_INTERVAL;
+/* Called from the RX tasklet for beacons of our AP */
+void mt7601u_phy_freq_cal_bcn(struct mt7601u_dev *dev, s8 freq_off,
+			      u8 phy_mode)
+{
+	struct mt7601u_freq_cal *fc = &dev->freq_cal;
+	u8 activate, deactivate;
+	int off;
 
-	if (last_offset > deactivate_threshold) {
-		if (dev->freq_cal.freq > 0)
-			dev->freq_cal.freq--;
-		else
-			dev->freq_cal.adjusting = false;
-	} else if (last_offset < -deactivate_threshold) {
-		if (dev->freq_cal.freq < 0xbf)
-			dev->freq_cal.freq++;
-		else
-			dev->freq_cal.adjusting = false;
+	if (!READ_ONCE(fc->enabled) ||
+	    test_bit(MT7601U_STATE_FREQ_CAL, &dev->state) ||
+	    test_bit(MT7601U_STATE_SCANNING, &dev->state))
+		return;
+	smp_rmb();
+	if (time_before(jiffies, READ_ONCE(fc->holdoff)))
+		return;
+	if (!mt7601u_freq_cal_thresholds(phy_mode, &activate, &deactivate))
+		return;
+
+	/* Offsets measured on different PHY modes are not comparable */
+	if (phy_mode != fc->phy_mode) {
+		fc->phy_mode = phy_mode;
+		fc->n_bcn = 0;
 	}
 
-	trace_freq_cal_adjust(dev, dev->freq_cal.freq);
-	mt7601u_rf_wr(dev, 0, 12, dev->freq_cal.freq);
-	mt7601u_vco_cal(dev);
+	if (!fc->n_bcn++)
+		fc->avg = freq_off * 16;
+	else
+		fc->avg += (freq_off * 16 - fc->avg) / MT_FREQ_CAL_EWMA_WEIGHT;
+	fc->beacons++;
+
+	if (fc->n_bcn < MT_FREQ_CAL_MIN_BCN)
+		return;
+
+	off = abs(fc->avg) / 16;
+	if (off >= activate)
+		fc->adjusting = true;
+	else if (off <= deactivate)
+		fc->adjusting = false;
+
+	if (!fc->adjusting)
+		return;
+
+	/* Lost to mt7601u_freq_cal_block() since the check above */
+	if (test_and_set_bit(MT7601U_STATE_FREQ_CAL, &dev->state))
+		return;
 
-	return dev->freq_cal.adjusting ? MT_FREQ_CAL_ADJ_INTERVAL :
-					 MT_FREQ_CAL_CHECK_INTERVAL;
+	fc->step_off = fc->avg / 16;
+	ieee80211_queue_work(dev->hw, &fc->work);
 }
 
 static void mt7601u_phy_freq_cal(struct work_struct *work)
 {
 	struct mt7601u_dev *dev = container_of(work, struct mt7601u_dev,
-					       freq_cal.work.work);
-	s8 last_offset;
-	u8 phy_mode;
-	unsigned long delay;
+					       freq_cal.work);
+	struct mt7601u_freq_cal *fc = &dev->freq_cal;
+	bool at_limit = false;
+	int off = fc->step_off;
 
-	spin_lock_bh(&dev->con_mon_lock);
-	last_offset = dev->bcn_freq_off;
-	phy_mode = dev->bcn_phy_mode;
-	spin_unlock_bh(&dev->con_mon_lock);
+	trace_freq_cal_offset(dev, fc->phy_mode, off);
 
-	delay = __mt7601u_phy_freq_cal(dev, last_offset, phy_mode);
-	ieee80211_queue_delayed_work(dev->hw, &dev->freq_cal.work, delay);
+	if (off > 0) {
+		if (fc->freq > 0)
+			fc->freq--;
+		else
+			at_limit = true;
+	} else {
+		if (fc->freq < 0xbf)
+			fc->freq++;
+		else
+			at_limit = true;
+	}
 
-	spin_lock_bh(&dev->con_mon_lock);
-	dev->bcn_freq_off = MT_FREQ_OFFSET_INVALID;
-	spin_unlock_bh(&dev->con_mon_lock);
+	if (!at_limit) {
+		trace_freq_cal_adjust(dev, fc->freq);
+		mt7601u_rf_wr(dev, 0, 12, fc->freq);
+		mt7601u_vco_cal(dev);
+		fc->steps++;
+	}
+
+	/* Beacons received so far were measured against the old setting */
+	mt7601u_freq_cal_reset(dev, MT_FREQ_CAL_ADJ_INTERVAL, at_limit);
 }
 
 void mt7601u_phy_con_cal_onoff(struct mt7601u_dev *dev,
 			       struct ieee80211_bss_conf *info)
 {
-	if (!info->assoc)
-		cancel_delayed_work_sync(&dev->freq_cal.work);
+	mt7601u_freq_cal_block(dev);
 
-	/* Start/stop collecting beacon data */
-	spin_lock_bh(&dev->con_mon_lock);
+	/* Start/stop collecting beacon data.  The RX tasklet reads the BSSID
+	 * under the seqcount, keep it off this CPU while we write.
+	 */
+	local_bh_disable();
+	write_seqcount_begin(&dev->con_mon_seq);
 	ether_addr_copy(dev->ap_bssid, info->bssid);
-	dev->avg_rssi = 0;
-	dev->bcn_freq_off = MT_FREQ_OFFSET_INVALID;
-	spin_unlock_bh(&dev->con_mon_lock);
+	write_seqcount_end(&dev->con_mon_seq);
+	local_bh_enable();
 
+	set_bit(MT_CON_MON_RESET_RSSI, &dev->con_mon_reset);
 	dev->freq_cal.freq = dev->ee->rf_freq_off;
-	dev->freq_cal.enabled = info->assoc;
-	dev->freq_cal.adjusting = false;
-
-	if (info->assoc)
-		ieee80211_queue_delayed_work(dev->hw, &dev->freq_cal.work,
-					     MT_FREQ_CAL_INIT_DELAY);
+	WRITE_ONCE(dev->freq_cal.enabled, info->assoc);
+	mt7601u_freq_cal_reset(dev, MT_FREQ_CAL_INIT_DELAY, true);
 }
 
 static int mt7601u_init_cal(struct mt7601u_dev *dev)
 {
-	u32 mac_ctrl;
+	struct mt7601u_cal_cache *cc = &dev->cal_cache;
+	struct mt7601u_cal_cache_entry *ent;
+	ktime_t start = ktime_get();
+	u32 mac_ctrl, us;
 	int ret;
 
 	dev->raw_temp = mt7601u_read_bootup_temp(dev);
 	dev->curr_temp = (dev->raw_temp - dev->ee->ref_temp) *
 		MT_EE_TEMPERATURE_SLOPE;
+
 	dev->dpd_temp = dev->curr_temp;
+	ent = mt7601u_cal_cache_find(dev);
 
 	mac_ctrl = mt7601u_rr(dev, MT_MAC_SYS_CTRL);
 
@@ -1161,24 +1579,35 @@ static int mt7601u_init_cal(struct mt7601u_dev *dev)
 
 	mt7601u_rxdc_cal(dev);
 
-	mt7601u_tssi_dc_gain_cal(dev);
+	if (ent)
+		mt7601u_cal_cache_replay(dev, ent);
+	else
+		mt7601u_tssi_dc_gain_cal(dev);
 
 	mt7601u_wr(dev, MT_MAC_SYS_CTRL, mac_ctrl);
 
 	mt7601u_temp_comp(dev, true);
 
+	us = ktime_us_delta(ktime_get(), start);
+	if (ent) {
+		cc->hits++;
+		cc->replay_us = us;
+	} else {
+		cc->misses++;
+		cc->full_us = us;
+	}
+
 	return 0;
 }
 
 int mt7601u_bbp_set_bw(struct mt7601u_dev *dev, int bw)
 {
+	struct mt76_reg_rmw bw_sel = { 4, 0x18, bw == MT_BW_20 ? 0 : 0x10 };
 	u32 val, old;
 
 	if (bw == dev->bw) {
 		/* Vendor driver does the rmc even when no change is needed. */
-		mt7601u_bbp_rmc(dev, 4, 0x18, bw == MT_BW_20 ? 0 : 0x10);
-
-		return 0;
+		return mt7601u_rmw_regs(dev, MT_MCU_MEMMAP_BBP, &bw_sel, 1);
 	}
 	dev->bw = bw;
 
@@ -1189,7 +1618,7 @@ int mt7601u_bbp_set_bw(struct mt7601u_dev *dev, int bw)
 	mt76_poll(dev, MT_MAC_STATUS, MT_MAC_STATUS_TX | MT_MAC_STATUS_RX,
 		  0, 500000);
 
-	mt7601u_bbp_rmc(dev, 4, 0x18, bw == MT_BW_20 ? 0 : 0x10);
+	mt7601u_rmw_regs(dev, MT_MCU_MEMMAP_BBP, &bw_sel, 1);
 
 	mt7601u_wr(dev, MT_MAC_SYS_CTRL, old);
 
@@ -1242,10 +1671,14 @@ int mt7601u_phy_init(struct mt7601u_dev *dev)
 	if (ret)
 		return ret;
 
+	ret = mt7601u_chan_prog_init(dev);
+	if (ret)
+		return ret;
+
 	dev->prev_pwr_diff = 100;
 
 	INIT_DELAYED_WORK(&dev->cal_work, mt7601u_phy_calibrate);
-	INIT_DELAYED_WORK(&dev->freq_cal.work, mt7601u_phy_freq_cal);
+	INIT_WORK(&dev->freq_cal.work, mt7601u_phy_freq_cal);
 
 	return 0;
 }
@@ -0,0 +1,343 @@
+/*
+ * Copyright (C) 2015 Jakub Kicinski <kubakici@wp.pl>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/* TX traffic generator.
+ *
+ * Synthesizes 802.11 data frames and feeds them straight into the DMA layer
+ * bypassing mac80211, which allows measuring the ceiling of the USB TX path
+ * without an association or a peer.  Controlled through the pktgen/
+ * directory in debugfs:
+ *	len, rate, ac, wcid, count - parameters of the next run,
+ *	mock - complete URBs locally instead of submitting them to USB,
+ *	ctrl - write 1 to start and 0 to stop a run,
+ *	results - throughput, URB latency and ring occupancy.
+ *
+ * Note that while a mock run is in progress frames from mac80211 are
+ * dropped (counted as mock_drops in results), completing them locally would
+ * report them as acknowledged.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/etherdevice.h>
+
+#include "mt7601u.h"
+#include "mac.h"
+
+static struct sk_buff *
+mt7601u_pktgen_alloc(struct mt7601u_dev *dev, u32 len)
+{
+	struct ieee80211_hdr_3addr *hdr;
+	struct sk_buff *skb;
+
+	/* TXINFO+TXWI in front, padding and zero trailer at the end */
+	skb = alloc_skb(MT_TX_HEADROOM + sizeof(*hdr) + len + 8, GFP_KERNEL);
+	if (!skb)
+		return NULL;
+	skb_reserve(skb, MT_TX_HEADROOM);
+
+	hdr = (struct ieee80211_hdr_3addr *)skb_put(skb, sizeof(*hdr));
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->frame_control = cpu_to_le16(IEEE80211_FTYPE_DATA |
+					 IEEE80211_STYPE_DATA);
+	eth_broadcast_addr(hdr->addr1);
+	memcpy(hdr->addr2, dev->macaddr, ETH_ALEN);
+	memcpy(hdr->addr3, dev->macaddr, ETH_ALEN);
+
+	memset(skb_put(skb, len), 0, len);
+
+	return skb;
+}
+
+static int mt7601u_pktgen_xmit(struct mt7601u_dev *dev, u32 len, u16 rate,
+			       u8 ac, u8 wcid_idx)
+{
+	struct mt76_wcid *wcid;
+	struct sk_buff *skb;
+	int ret;
+
+	skb = mt7601u_pktgen_alloc(dev, len);
+	if (!skb)
+		return -ENOMEM;
+
+	rcu_read_lock();
+	wcid = rcu_dereference(dev->wcid[wcid_idx]);
+	if (!wcid)
+		wcid = dev->mon_wcid;
+	ret = mt7601u_tx_pktgen(dev, skb, wcid, rate, ac);
+	rcu_read_unlock();
+
+	return ret;
+}
+
+static bool mt7601u_pktgen_can_xmit(struct mt7601u_dev *dev, u8 ac)
+{
+	u32 entries;
+
+	return READ_ONCE(dev->pktgen.stop) ||
+	       mt7601u_tx_queue_used(dev, ac, &entries) < entries;
+}
+
+static void mt7601u_pktgen_work(struct work_struct *work)
+{
+	struct mt7601u_pktgen *pg = container_of(work, struct mt7601u_pktgen,
+						 work);
+	struct mt7601u_dev *dev = container_of(pg, struct mt7601u_dev, pktgen);
+	struct mt7601u_pktgen_params *p = &pg->run;
+	struct mt7601u_pktgen_stats *st = &pg->stats;
+	u32 len = p->len, count = p->count;
+	u32 used, entries, n = 0;
+	u16 rate = p->rate;
+	u8 ac = p->ac, wcid = p->wcid;
+
+	while (!READ_ONCE(pg->stop) && (!count || n < count)) {
+		wait_event_timeout(dev->tx_flush_wq,
+				   mt7601u_pktgen_can_xmit(dev, ac),
+				   MT_TX_FLUSH_TIMEOUT);
+
+		used = mt7601u_tx_queue_used(dev, ac, &entries);
+		if (used >= entries)
+			continue;
+
+		st->occ_total += used;
+		st->occ_max = max(st->occ_max, used);
+
+		if (mt7601u_pktgen_xmit(dev, len, rate, ac, wcid))
+			st->xmit_failed++;
+		else
+			st->sent++;
+		n++;
+
+		cond_resched();
+	}
+
+	/* Let the frames still in flight contribute to the results */
+	mt7601u_dma_flush_tx(dev, ~0, false, MT_TX_FLUSH_TIMEOUT);
+
+	clear_bit(MT7601U_STATE_MOCK_URB, &dev->state);
+	clear_bit(MT7601U_STATE_PKTGEN, &dev->state);
+}
+
+void mt7601u_pktgen_tx_done(struct mt7601u_dev *dev, struct sk_buff *skb)
+{
+	struct mt7601u_pktgen_stats *st = &dev->pktgen.stats;
+	struct mt7601u_tx_cb *cb = mt7601u_tx_skb_cb(skb);
+	ktime_t now = ktime_get();
+	u32 lat;
+
+	lat = ktime_us_delta(now, skb->tstamp);
+	st->lat_total_us += lat;
+	st->lat_max_us = max(st->lat_max_us, lat);
+	st->end = now;
+
+	if (cb->flags & MT_TX_CB_DMA_FAIL) {
+		st->failed++;
+	} else {
+		st->done++;
+		st->bytes += cb->pkt_len;
+	}
+
+	dev_kfree_skb(skb);
+}
+
+/* Stand-in for usb_submit_urb() in mock mode, URBs succeed immediately and
+ * are completed in order from a tasklet through their regular callback.
+ */
+int mt7601u_pktgen_mock_submit(struct mt7601u_dev *dev, struct urb *urb)
+{
+	struct mt7601u_pktgen *pg = &dev->pktgen;
+	unsigned long flags;
+
+	urb->status = 0;
+	urb->actual_length = urb->transfer_buffer_length;
+
+	spin_lock_irqsave(&pg->mock_lock, flags);
+	list_add_tail(&urb->urb_list, &pg->mock_urbs);
+	spin_unlock_irqrestore(&pg->mock_lock, flags);
+
+	tasklet_schedule(&pg->mock_tasklet);
+
+	return 0;
+}
+
+static void mt7601u_pktgen_mock_tasklet(unsigned long data)
+{
+	struct mt7601u_dev *dev = (struct mt7601u_dev *) data;
+	struct mt7601u_pktgen *pg = &dev->pktgen;
+	struct urb *urb, *tmp;
+	unsigned long flags;
+	LIST_HEAD(list);
+
+	spin_lock_irqsave(&pg->mock_lock, flags);
+	list_splice_init(&pg->mock_urbs, &list);
+	spin_unlock_irqrestore(&pg->mock_lock, flags);
+
+	list_for_each_entry_safe(urb, tmp, &list, urb_list) {
+		list_del_init(&urb->urb_list);
+		urb->complete(urb);
+	}
+}
+
+static int mt7601u_pktgen_start(struct mt7601u_dev *dev)
+{
+	struct mt7601u_pktgen *pg = &dev->pktgen;
+	struct mt7601u_pktgen_params p;
+
+	if (!test_bit(MT7601U_STATE_INITIALIZED, &dev->state))
+		return -ENODEV;
+
+	/* debugfs can change @cfg any time, validate and use a copy */
+	p.len = READ_ONCE(pg->cfg.len);
+	p.rate = READ_ONCE(pg->cfg.rate);
+	p.ac = READ_ONCE(pg->cfg.ac);
+	p.wcid = READ_ONCE(pg->cfg.wcid);
+	p.count = READ_ONCE(pg->cfg.count);
+	p.mock = READ_ONCE(pg->cfg.mock);
+	if (p.ac >= IEEE80211_NUM_ACS || p.wcid >= N_WCIDS ||
+	    p.len > IEEE80211_MAX_DATA_LEN || p.rate > U16_MAX)
+		return -EINVAL;
+
+	if (test_and_set_bit(MT7601U_STATE_PKTGEN, &dev->state))
+		return -EBUSY;
+	pg->run = p;
+
+	memset(&pg->stats, 0, sizeof(pg->stats));
+	pg->stats.start = ktime_get();
+	pg->stats.end = pg->stats.start;
+	WRITE_ONCE(pg->stop, false);
+
+	if (p.mock)
+		set_bit(MT7601U_STATE_MOCK_URB, &dev->state);
+
+	queue_work(system_long_wq, &pg->work);
+
+	return 0;
+}
+
+void mt7601u_pktgen_stop(struct mt7601u_dev *dev)
+{
+	struct mt7601u_pktgen *pg = &dev->pktgen;
+
+	WRITE_ONCE(pg->stop, true);
+	wake_up(&dev->tx_flush_wq);
+	cancel_work_sync(&pg->work);
+
+	/* Cancelled before it could run */
+	clear_bit(MT7601U_STATE_MOCK_URB, &dev->state);
+	clear_bit(MT7601U_STATE_PKTGEN, &dev->state);
+
+	tasklet_kill(&pg->mock_tasklet);
+}
+
+void mt7601u_pktgen_init(struct mt7601u_dev *dev)
+{
+	struct mt7601u_pktgen *pg = &dev->pktgen;
+
+	INIT_WORK(&pg->work, mt7601u_pktgen_work);
+	spin_lock_init(&pg->mock_lock);
+	INIT_LIST_HEAD(&pg->mock_urbs);
+	tasklet_init(&pg->mock_tasklet, mt7601u_pktgen_mock_tasklet,
+		     (unsigned long) dev);
+
+	pg->cfg.len = 1500;
+	pg->cfg.rate = MT76_SET(MT_TXWI_RATE_PHY_MODE, MT_PHY_TYPE_HT) | 7;
+	pg->cfg.ac = IEEE80211_AC_BE;
+}
+
+static int mt7601u_pktgen_ctrl_set(void *data, u64 val)
+{
+	struct mt7601u_dev *dev = data;
+
+	if (val)
+		return mt7601u_pktgen_start(dev);
+
+	mt7601u_pktgen_stop(dev);
+	return 0;
+}
+
+static int mt7601u_pktgen_ctrl_get(void *data, u64 *val)
+{
+	struct mt7601u_dev *dev = data;
+
+	*val = test_bit(MT7601U_STATE_PKTGEN, &dev->state);
+	return 0;
+}
+
+DEFINE_SIMPLE_ATTRIBUTE(fops_pktgen_ctrl, mt7601u_pktgen_ctrl_get,
+			mt7601u_pktgen_ctrl_set, "%llu\n");
+
+static int mt7601u_pktgen_results_read(struct seq_file *file, void *data)
+{
+	struct mt7601u_dev *dev = file->private;
+	struct mt7601u_pktgen_stats *st = &dev->pktgen.stats;
+	u64 us, pps, kbps, completed = st->done + st->failed;
+
+	us = max_t(s64, 1, ktime_us_delta(st->end, st->start));
+	pps = div64_u64(st->done * USEC_PER_SEC, us);
+	kbps = div64_u64(st->bytes * 8 * 1000, us);
+
+	seq_printf(file, "running:\t%d\n",
+		   test_bit(MT7601U_STATE_PKTGEN, &dev->state));
+	seq_printf(file, "mock:\t\t%d\n",
+		   test_bit(MT7601U_STATE_MOCK_URB, &dev->state));
+	seq_printf(file, "mock_drops:\t%d\n",
+		   atomic_read(&dev->pktgen.mock_drops));
+	seq_printf(file, "sent:\t\t%llu\n", st->sent);
+	seq_printf(file, "done:\t\t%llu\n", st->done);
+	seq_printf(file, "xmit_failed:\t%llu\n", st->xmit_failed);
+	seq_printf(file, "failed:\t\t%llu\n", st->failed);
+	seq_printf(file, "duration_us:\t%llu\n", us);
+	seq_printf(file, "pps:\t\t%llu\n", pps);
+	seq_printf(file, "mbps:\t\t%llu.%03llu\n", kbps / 1000, kbps % 1000);
+	seq_printf(file, "lat_avg_us:\t%llu\n",
+		   completed ? div64_u64(st->lat_total_us, completed) : 0);
+	seq_printf(file, "lat_max_us:\t%u\n", st->lat_max_us);
+	seq_printf(file, "ring_avg:\t%llu\n",
+		   st->sent ? div64_u64(st->occ_total, st->sent) : 0);
+	seq_printf(file, "ring_max:\t%u\n", st->occ_max);
+
+	return 0;
+}
+
+static int mt7601u_pktgen_results_open(struct inode *inode, struct file *f)
+{
+	return single_open(f, mt7601u_pktgen_results_read, inode->i_private);
+}
+
+static const struct file_operations fops_pktgen_results = {
+	.open = mt7601u_pktgen_results_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+void mt7601u_pktgen_init_debugfs(struct mt7601u_dev *dev,
+				 struct dentry *parent)
+{
+	struct mt7601u_pktgen *pg = &dev->pktgen;
+	struct dentry *dir;
+
+	dir = debugfs_create_dir("pktgen", parent);
+	if (!dir)
+		return;
+
+	debugfs_create_u32("len", S_IRUSR | S_IWUSR, dir, &pg->cfg.len);
+	debugfs_create_x32("rate", S_IRUSR | S_IWUSR, dir, &pg->cfg.rate);
+	debugfs_create_u32("ac", S_IRUSR | S_IWUSR, dir, &pg->cfg.ac);
+	debugfs_create_u32("wcid", S_IRUSR | S_IWUSR, dir, &pg->cfg.wcid);
+	debugfs_create_u32("count", S_IRUSR | S_IWUSR, dir, &pg->cfg.count);
+	debugfs_create_u32("mock", S_IRUSR | S_IWUSR, dir, &pg->cfg.mock);
+	debugfs_create_file("ctrl", S_IRUSR | S_IWUSR, dir, dev,
+			    &fops_pktgen_ctrl);
+	debugfs_create_file("results", S_IRUSR, dir, dev,
+			    &fops_pktgen_results);
+}
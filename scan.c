@@ -0,0 +1,353 @@
+/*
+ * Copyright (C) 2015 Jakub Kicinski <kubakici@wp.pl>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/* Driver-run hardware scan.
+ *
+ * The firmware has no scan offload, so the channel list is walked by
+ * a delayed work instead of mac80211's software scan.  This lets us keep
+ * the per-channel dwell short (no mac80211 round trip or PS handshake per
+ * channel) and, when associated, go back to the operating channel every
+ * few channels so queued data does not stall for the whole scan.
+ * Tunables and statistics live in the scan/ directory in debugfs.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/etherdevice.h>
+
+#include "mt7601u.h"
+
+/* Hand a driver-generated frame to the TX path, mac80211 picks the rate */
+static void mt7601u_scan_tx(struct mt7601u_dev *dev, struct sk_buff *skb,
+			    enum nl80211_band band)
+{
+	struct ieee80211_tx_control control = {};
+
+	skb_set_queue_mapping(skb, IEEE80211_AC_VO);
+
+	rcu_read_lock();
+	if (!ieee80211_tx_prepare_skb(dev->hw, dev->scan.vif, skb, band,
+				      &control.sta)) {
+		rcu_read_unlock();
+		ieee80211_free_txskb(dev->hw, skb);
+		return;
+	}
+
+	local_bh_disable();
+	mt7601u_tx(dev->hw, &control, skb);
+	local_bh_enable();
+	rcu_read_unlock();
+}
+
+static void mt7601u_scan_probe(struct mt7601u_dev *dev,
+			       struct ieee80211_channel *chan)
+{
+	struct mt7601u_scan *s = &dev->scan;
+	struct ieee80211_scan_ies *ies = &s->req->ies;
+	struct cfg80211_scan_request *req = &s->req->req;
+	struct ieee80211_tx_info *info;
+	struct sk_buff *skb;
+	size_t ie_len;
+	int i;
+
+	ie_len = ies->len[chan->band] + ies->common_ie_len;
+
+	for (i = 0; i < req->n_ssids; i++) {
+		skb = ieee80211_probereq_get(dev->hw, s->addr,
+					     req->ssids[i].ssid,
+					     req->ssids[i].ssid_len, ie_len);
+		if (!skb)
+			continue;
+
+		memcpy(skb_put(skb, ies->len[chan->band]), ies->ies[chan->band],
+		       ies->len[chan->band]);
+		memcpy(skb_put(skb, ies->common_ie_len), ies->common_ies,
+		       ies->common_ie_len);
+
+		info = IEEE80211_SKB_CB(skb);
+		info->flags |= IEEE80211_TX_CTL_NO_ACK;
+		if (req->no_cck)
+			info->flags |= IEEE80211_TX_CTL_NO_CCK_RATE;
+
+		mt7601u_scan_tx(dev, skb, chan->band);
+		s->probes++;
+	}
+}
+
+/* Tell the AP we are (not) going to listen, flushing TX after going to
+ * sleep makes sure the frame is out before we leave the channel.
+ */
+static void mt7601u_scan_nullfunc(struct mt7601u_dev *dev, bool ps)
+{
+	struct ieee80211_hdr *hdr;
+	struct sk_buff *skb;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 0, 0)
+	skb = ieee80211_nullfunc_get(dev->hw, dev->scan.vif, -1, false);
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(4, 14, 0)
+	skb = ieee80211_nullfunc_get(dev->hw, dev->scan.vif, false);
+#else
+	skb = ieee80211_nullfunc_get(dev->hw, dev->scan.vif);
+#endif
+	if (!skb)
+		return;
+
+	hdr = (struct ieee80211_hdr *) skb->data;
+	if (ps)
+		hdr->frame_control |= cpu_to_le16(IEEE80211_FCTL_PM);
+
+	mt7601u_scan_tx(dev, skb, dev->hw->conf.chandef.chan->band);
+}
+
+static void mt7601u_scan_leave_home(struct mt7601u_dev *dev)
+{
+	struct mt7601u_scan *s = &dev->scan;
+
+	ieee80211_stop_queues(dev->hw);
+	if (s->assoc)
+		mt7601u_scan_nullfunc(dev, true);
+	mt7601u_dma_flush_tx(dev, GENMASK(IEEE80211_NUM_ACS - 1, 0), false,
+			     MT_TX_FLUSH_TIMEOUT);
+
+	s->on_home = false;
+	s->in_chunk = 0;
+	s->off_start = ktime_get();
+	if (s->assoc)
+		s->interruptions++;
+}
+
+static void mt7601u_scan_go_home(struct mt7601u_dev *dev)
+{
+	struct mt7601u_scan *s = &dev->scan;
+	u32 off_ms;
+
+	/* Channel switch resets AGC while scanning, bring back the value
+	 * tuned for the AP.  Next hop off channel resets it again.
+	 */
+	mt7601u_phy_set_channel(dev, &dev->hw->conf.chandef);
+	mt7601u_agc_restore(dev);
+
+	if (s->on_home)
+		return;
+
+	s->on_home = true;
+	if (s->assoc)
+		mt7601u_scan_nullfunc(dev, false);
+	ieee80211_wake_queues(dev->hw);
+
+	if (!s->assoc)
+		return;
+
+	off_ms = ktime_ms_delta(ktime_get(), s->off_start);
+	s->off_total_ms += off_ms;
+	s->off_max_ms = max(s->off_max_ms, off_ms);
+}
+
+static void mt7601u_scan_finish(struct mt7601u_dev *dev)
+{
+	struct mt7601u_scan *s = &dev->scan;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 8, 0)
+	struct cfg80211_scan_info info = {
+		.aborted = s->aborted,
+	};
+#endif
+
+	/* Clear the flag first so that the channel switch below restarts
+	 * calibration on the operating channel.
+	 */
+	clear_bit(MT7601U_STATE_SCANNING, &dev->state);
+	mt7601u_scan_go_home(dev);
+
+	s->last_ms = ktime_ms_delta(ktime_get(), s->start);
+	s->max_ms = max(s->max_ms, s->last_ms);
+	if (s->aborted)
+		s->aborts++;
+	else
+		s->scans++;
+	s->req = NULL;
+	s->vif = NULL;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 8, 0)
+	ieee80211_scan_completed(dev->hw, &info);
+#else
+	ieee80211_scan_completed(dev->hw, s->aborted);
+#endif
+}
+
+static void mt7601u_scan_work(struct work_struct *work)
+{
+	struct mt7601u_dev *dev = container_of(work, struct mt7601u_dev,
+					       scan.work.work);
+	struct mt7601u_scan *s = &dev->scan;
+	struct cfg80211_scan_request *req;
+	struct cfg80211_chan_def chandef;
+	struct ieee80211_channel *chan;
+	u32 dwell;
+
+	mutex_lock(&dev->mutex);
+
+	if (!s->req)
+		goto out;
+	req = &s->req->req;
+
+	if (s->aborted || s->chan_idx >= req->n_channels) {
+		mt7601u_scan_finish(dev);
+		goto out;
+	}
+
+	if (!s->on_home && s->assoc && s->chunk && s->in_chunk >= s->chunk) {
+		mt7601u_scan_go_home(dev);
+		dwell = s->home_dwell;
+		goto requeue;
+	}
+
+	if (s->on_home)
+		mt7601u_scan_leave_home(dev);
+
+	chan = req->channels[s->chan_idx++];
+	cfg80211_chandef_create(&chandef, chan, NL80211_CHAN_NO_HT);
+	mt7601u_phy_set_channel(dev, &chandef);
+	s->in_chunk++;
+
+	if (!req->n_ssids ||
+	    chan->flags & (IEEE80211_CHAN_NO_IR | IEEE80211_CHAN_RADAR)) {
+		dwell = s->dwell_passive;
+	} else {
+		mt7601u_scan_probe(dev, chan);
+		dwell = s->dwell_active;
+	}
+requeue:
+	ieee80211_queue_delayed_work(dev->hw, &s->work,
+				     msecs_to_jiffies(dwell));
+out:
+	mutex_unlock(&dev->mutex);
+}
+
+int mt7601u_hw_scan(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
+		    struct ieee80211_scan_request *hw_req)
+{
+	struct mt7601u_dev *dev = hw->priv;
+	struct mt7601u_scan *s = &dev->scan;
+	struct cfg80211_scan_request *req = &hw_req->req;
+	int ret = 0;
+
+	mutex_lock(&dev->mutex);
+
+	if (s->req) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	s->req = hw_req;
+	s->vif = vif;
+	s->chan_idx = 0;
+	s->in_chunk = 0;
+	s->on_home = true;
+	s->aborted = false;
+	s->assoc = vif->bss_conf.assoc;
+	s->start = ktime_get();
+
+	if (req->flags & NL80211_SCAN_FLAG_RANDOM_ADDR)
+		get_random_mask_addr(s->addr, req->mac_addr,
+				     req->mac_addr_mask);
+	else
+		ether_addr_copy(s->addr, vif->addr);
+
+	mt7601u_agc_save(dev);
+	set_bit(MT7601U_STATE_SCANNING, &dev->state);
+
+	ieee80211_queue_delayed_work(hw, &s->work, 0);
+out:
+	mutex_unlock(&dev->mutex);
+	return ret;
+}
+
+void mt7601u_cancel_hw_scan(struct ieee80211_hw *hw, struct ieee80211_vif *vif)
+{
+	struct mt7601u_dev *dev = hw->priv;
+	struct mt7601u_scan *s = &dev->scan;
+
+	cancel_delayed_work_sync(&s->work);
+
+	mutex_lock(&dev->mutex);
+	if (s->req) {
+		s->aborted = true;
+		mt7601u_scan_finish(dev);
+	}
+	mutex_unlock(&dev->mutex);
+}
+
+void mt7601u_scan_init(struct mt7601u_dev *dev)
+{
+	struct mt7601u_scan *s = &dev->scan;
+
+	INIT_DELAYED_WORK(&s->work, mt7601u_scan_work);
+
+	s->dwell_active = MT_SCAN_DWELL_ACTIVE;
+	s->dwell_passive = MT_SCAN_DWELL_PASSIVE;
+	s->chunk = MT_SCAN_CHUNK;
+	s->home_dwell = MT_SCAN_HOME_DWELL;
+}
+
+static int mt7601u_scan_stats_read(struct seq_file *file, void *data)
+{
+	struct mt7601u_dev *dev = file->private;
+	struct mt7601u_scan *s = &dev->scan;
+
+	mutex_lock(&dev->mutex);
+
+	seq_printf(file, "running:\t%d\n", !!s->req);
+	seq_printf(file, "scans:\t\t%u\n", s->scans);
+	seq_printf(file, "aborts:\t\t%u\n", s->aborts);
+	seq_printf(file, "probes:\t\t%u\n", s->probes);
+	seq_printf(file, "last_ms:\t%u\n", s->last_ms);
+	seq_printf(file, "max_ms:\t\t%u\n", s->max_ms);
+	seq_printf(file, "interruptions:\t%u\n", s->interruptions);
+	seq_printf(file, "off_chan_avg_ms:\t%llu\n", s->interruptions ?
+		   div_u64(s->off_total_ms, s->interruptions) : 0);
+	seq_printf(file, "off_chan_max_ms:\t%u\n", s->off_max_ms);
+
+	mutex_unlock(&dev->mutex);
+
+	return 0;
+}
+
+static int mt7601u_scan_stats_open(struct inode *inode, struct file *f)
+{
+	return single_open(f, mt7601u_scan_stats_read, inode->i_private);
+}
+
+static const struct file_operations fops_scan_stats = {
+	.open = mt7601u_scan_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+void mt7601u_scan_init_debugfs(struct mt7601u_dev *dev, struct dentry *parent)
+{
+	struct mt7601u_scan *s = &dev->scan;
+	struct dentry *dir;
+
+	dir = debugfs_create_dir("scan", parent);
+	if (!dir)
+		return;
+
+	debugfs_create_u32("dwell_active", S_IRUSR | S_IWUSR, dir,
+			   &s->dwell_active);
+	debugfs_create_u32("dwell_passive", S_IRUSR | S_IWUSR, dir,
+			   &s->dwell_passive);
+	debugfs_create_u32("chunk", S_IRUSR | S_IWUSR, dir, &s->chunk);
+	debugfs_create_u32("home_dwell", S_IRUSR | S_IWUSR, dir,
+			   &s->home_dwell);
+	debugfs_create_file("stats", S_IRUSR, dir, dev, &fops_scan_stats);
+}
@@ -351,6 +351,71 @@ TRACE_EVENT(mt_tx_status,
 		  DEV_PR_ARG, __entry->stat1, __entry->stat2)
 );
 
+TRACE_EVENT(mt_tx_flush,
+	TP_PROTO(struct mt7601u_dev *dev, u32 queues, bool drop, u32 duration,
+		 int ret),
+	TP_ARGS(dev, queues, drop, duration, ret),
+	TP_STRUCT__entry(
+		DEV_ENTRY
+		__field(u32, queues)
+		__field(bool, drop)
+		__field(u32, duration)
+		__field(int, ret)
+	),
+	TP_fast_assign(
+		DEV_ASSIGN;
+		__entry->queues = queues;
+		__entry->drop = drop;
+		__entry->duration = duration;
+		__entry->ret = ret;
+	),
+	TP_printk(DEV_PR_FMT "q:%x drop:%d %uus ret:%d",
+		  DEV_PR_ARG, __entry->queues, __entry->drop,
+		  __entry->duration, __entry->ret)
+);
+
+TRACE_EVENT(mt_tx_queue_state,
+	TP_PROTO(struct mt7601u_dev *dev, int ep, u32 used, bool stopped),
+	TP_ARGS(dev, ep, used, stopped),
+	TP_STRUCT__entry(
+		DEV_ENTRY
+		__field(u8, ep)
+		__field(u32, used)
+		__field(bool, stopped)
+	),
+	TP_fast_assign(
+		DEV_ASSIGN;
+		__entry->ep = ep;
+		__entry->used = used;
+		__entry->stopped = stopped;
+	),
+	TP_printk(DEV_PR_FMT "ep:%hhu used:%u stopped:%d",
+		  DEV_PR_ARG, __entry->ep, __entry->used, __entry->stopped)
+);
+
+TRACE_EVENT(mt_prot_policy,
+	TP_PROTO(struct mt7601u_dev *dev, u32 old_level, u32 new_level,
+		 u32 retry_pct, u32 fail_pct),
+	TP_ARGS(dev, old_level, new_level, retry_pct, fail_pct),
+	TP_STRUCT__entry(
+		DEV_ENTRY
+		__field(u8, old_level)
+		__field(u8, new_level)
+		__field(u8, retry_pct)
+		__field(u8, fail_pct)
+	),
+	TP_fast_assign(
+		DEV_ASSIGN;
+		__entry->old_level = old_level;
+		__entry->new_level = new_level;
+		__entry->retry_pct = retry_pct;
+		__entry->fail_pct = fail_pct;
+	),
+	TP_printk(DEV_PR_FMT "level:%hhu->%hhu retry:%hhu%% fail:%hhu%%",
+		  DEV_PR_ARG, __entry->old_level, __entry->new_level,
+		  __entry->retry_pct, __entry->fail_pct)
+);
+
 TRACE_EVENT(mt_rx_dma_aggr,
 	TP_PROTO(struct mt7601u_dev *dev, int cnt, bool paged),
 	TP_ARGS(dev, cnt, paged),
@@ -12,6 +12,11 @@
  * GNU General Public License for more details.
  */
 
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
+
 #include "mt7601u.h"
 #include "trace.h"
 
@@ -25,12 +30,6 @@ enum mt76_txq_id {
 	__MT_TXQ_MAX
 };
 
-/* Hardware uses mirrored order of queues with Q0 having the highest priority */
-static u8 q2hwq(u8 q)
-{
-	return q ^ 0x3;
-}
-
 /* Take mac80211 Q id from the skb and translate it to hardware Q id */
 static u8 skb2q(struct sk_buff *skb)
 {
@@ -44,6 +43,21 @@ static u8 skb2q(struct sk_buff *skb)
 	return q2hwq(qid);
 }
 
+#define MT_PKTID_PROBE		9
+#define MT_PKTID_STATUS		12
+#define MT_PKTID_STATUS_N	4
+
+#define MT_PROBE_TIMEOUT	(HZ / 10)
+
+/* Frames mac80211 wants the real outcome of, they are held on the pending
+ * list of their WCID until their TX_STAT_FIFO entry is found.
+ */
+static bool mt7601u_tx_wants_status(struct ieee80211_tx_info *info)
+{
+	return info->flags & IEEE80211_TX_CTL_REQ_TX_STATUS &&
+	       !(info->flags & IEEE80211_TX_CTL_NO_ACK);
+}
+
 /* Note: TX retry reporting is a bit broken.
  *	 Retries are reported only once per AMPDU and often come a frame early
  *	 i.e. they are reported in the last status preceding the AMPDU. Apart
@@ -52,54 +66,125 @@ static u8 skb2q(struct sk_buff *skb)
  *	 applied), if status comes early on full FIFO it gets lost and retries
  *	 of the whole AMPDU become invisible.
  *	 As a work-around encode the desired rate in PKT_ID of TX descriptor
- *	 and based on that guess the retries (every rate is tried once).
+ *	 and based on that guess the retries (every rate is tried
+ *	 dev->mrr.tries times, see mt7601u_tx_fbk_hops()).
  *	 Only downside here is that for MCS0 we have to rely solely on
  *	 transmission failures as no retries can ever be reported.
  *	 Not having to read EXT_FIFO has a nice effect of doubling the number
  *	 of reports which can be fetched.
  *	 Also the vendor driver never uses the EXT_FIFO register so it may be
  *	 undertested.
+ *	 PKT_ID 0 disables status reporting, the remaining 15 values are split:
+ *	   1 - 8	requested rate + 1,
+ *	   MT_PKTID_PROBE	rate control probe, the requested rate is kept
+ *			in the WCID so only one probe can be in flight at
+ *			a time (see mt7601u_tx_probe_get()),
+ *	   MT_PKTID_STATUS ... + MT_PKTID_STATUS_N - 1
+ *			rolling per-WCID IDs of frames which wait for their
+ *			status (see mt7601u_tx_pending_add()), their rate is
+ *			kept in the skb.
+ *	 Only the last range can be used to match entries to frames, any
+ *	 number of other frames may share a rate PKT_ID.
+ */
+/* Claim the WCID's probe slot for a probe at @rate.  The slot is released
+ * when the probe's status is decoded, or taken over after MT_PROBE_TIMEOUT
+ * in case the status got lost.  Probes which don't get the slot are sent
+ * with a plain rate PKT_ID and accounted as regular frames.
  */
-static u8 mt7601u_tx_pktid_enc(struct mt7601u_dev *dev, u8 rate, bool is_probe)
+static bool mt7601u_tx_probe_get(struct mt76_wcid *wcid, u8 rate)
 {
-	u8 encoded = (rate + 1) + is_probe *  8;
+	unsigned long old = READ_ONCE(wcid->probe_sent);
 
-	/* Because PKT_ID 0 disables status reporting only 15 values are
-	 * available but 16 are needed (8 MCS * 2 for encoding is_probe)
-	 * - we need to cram together two rates. MCS0 and MCS7 with is_probe
-	 * share PKT_ID 9.
-	 */
-	if (is_probe && rate == 7)
-		return encoded - 7;
+	if (old && time_before(jiffies, old + MT_PROBE_TIMEOUT))
+		return false;
+	/* 0 means free, be one jiffy off rather than lose the claim */
+	if (cmpxchg(&wcid->probe_sent, old, jiffies | 1) != old)
+		return false;
 
-	return encoded;
+	WRITE_ONCE(wcid->probe_rate, rate);
+	return true;
 }
 
-static void
-mt7601u_tx_pktid_dec(struct mt7601u_dev *dev, struct mt76_tx_status *stat)
+static u8 mt7601u_tx_pktid_enc(struct mt76_wcid *wcid,
+			       struct ieee80211_tx_info *info, u8 rate)
+{
+	u32 seq;
+
+	if (mt7601u_tx_wants_status(info)) {
+		seq = atomic_inc_return(&wcid->pktid_seq);
+		return MT_PKTID_STATUS + seq % MT_PKTID_STATUS_N;
+	}
+
+	if (info->flags & IEEE80211_TX_CTL_RATE_CTRL_PROBE &&
+	    mt7601u_tx_probe_get(wcid, rate))
+		return MT_PKTID_PROBE;
+
+	return rate + 1;
+}
+
+/* Count fallback steps the HW took from @req_rate to @eff_rate.  HT rates
+ * follow the programmed fallback table, legacy ones the default one which
+ * steps down one rate at a time.
+ */
+static u8 mt7601u_tx_fbk_hops(u32 ht_fbk, u16 hw_rate, u8 req_rate,
+			      u8 eff_rate)
+{
+	u8 rate = req_rate, hops = 0;
+
+	if (MT76_GET(MT_TXWI_RATE_PHY_MODE, hw_rate) >= MT_PHY_TYPE_HT) {
+		while (rate != eff_rate && hops < 8) {
+			if (mt76_mrr_next(ht_fbk, rate) == rate)
+				break;
+			rate = mt76_mrr_next(ht_fbk, rate);
+			hops++;
+		}
+		if (rate == eff_rate)
+			return hops;
+	}
+
+	return req_rate > eff_rate ? req_rate - eff_rate : 0;
+}
+
+/* Recover the requested rate of a TX_STAT_FIFO entry, from the frame
+ * matched to it (@skb) if any, otherwise from the PKT_ID.  Entries of frames
+ * which waited for status but weren't found (e.g. expired) don't carry
+ * the rate, assume no fallback happened.
+ */
+void mt7601u_tx_status_dec(struct mt7601u_dev *dev,
+			   struct mt76_tx_status *stat, struct mt76_wcid *wcid,
+			   struct sk_buff *skb)
 {
-	u8 req_rate = stat->pktid;
 	u8 eff_rate = stat->rate & 0x7;
+	u8 req_rate = eff_rate;
 
-	req_rate -= 1;
+	if (skb) {
+		struct mt7601u_tx_cb *cb = mt7601u_tx_skb_cb(skb);
 
-	if (req_rate > 7) {
+		req_rate = cb->rate;
+		stat->is_probe = !!(cb->flags & MT_TX_CB_PROBE);
+	} else if (stat->pktid == MT_PKTID_PROBE) {
 		stat->is_probe = true;
-		req_rate -= 8;
-
-		/* Decide between MCS0 and MCS7 which share pktid 9 */
-		if (!req_rate && eff_rate)
-			req_rate = 7;
+		if (wcid) {
+			req_rate = READ_ONCE(wcid->probe_rate);
+			smp_store_release(&wcid->probe_sent, 0);
+		}
+	} else if (stat->pktid && stat->pktid < MT_PKTID_PROBE) {
+		req_rate = stat->pktid - 1;
 	}
 
-	stat->retry = req_rate - eff_rate;
+	/* Retries at the final rate are invisible, assume it succeeded or
+	 * failed on the first try.
+	 */
+	stat->req_rate = req_rate;
+	stat->tries = READ_ONCE(dev->mrr.tries);
+	stat->hops = mt7601u_tx_fbk_hops(READ_ONCE(dev->mrr.ht_fbk), stat->rate,
+					 req_rate, eff_rate);
+	stat->retry = stat->hops * stat->tries;
 }
 
 static void mt7601u_tx_skb_remove_dma_overhead(struct sk_buff *skb,
-					       struct ieee80211_tx_info *info)
+					       int pkt_len)
 {
-	int pkt_len = (unsigned long)info->status.status_driver_data[0];
-
 	skb_pull(skb, sizeof(struct mt76_txwi) + 4);
 	if (ieee80211_get_hdrlen_from_skb(skb) % 4)
 		mt76_remove_hdr_pad(skb);
@@ -107,21 +192,247 @@ static void mt7601u_tx_skb_remove_dma_overhead(struct sk_buff *skb,
 	skb_trim(skb, pkt_len);
 }
 
-void mt7601u_tx_status(struct mt7601u_dev *dev, struct sk_buff *skb)
+/* Account the time @skb spent in the TX latency stage which has just ended
+ * and mark the beginning of the next one.
+ */
+void mt7601u_tx_lat_update(struct mt7601u_dev *dev, struct sk_buff *skb,
+			   enum mt7601u_tx_lat_stage stage)
+{
+	struct mt7601u_tx_cb *cb = mt7601u_tx_skb_cb(skb);
+	u8 ac = skb_get_queue_mapping(skb);
+	u32 now = mt7601u_tx_stamp();
+	u32 bucket;
+
+	if (cb->flags & MT_TX_CB_PKTGEN ||
+	    WARN_ON_ONCE(ac >= IEEE80211_NUM_ACS))
+		return;
+
+	bucket = min_t(u32, fls(now - cb->stamp), MT_TX_LAT_HIST - 1);
+	dev->tx_lat.hist[ac][stage][bucket]++;
+	cb->stamp = now;
+}
+
+/* Frames which requested TX status are held until their entry shows up in
+ * the TX_STAT_FIFO, so that mac80211 gets the real outcome instead of a
+ * made-up ACK.  Only frames sent to known stations can be matched.
+ */
+static bool mt7601u_tx_pending_add(struct mt7601u_dev *dev,
+				   struct sk_buff *skb)
 {
 	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	struct mt7601u_tx_cb *cb = mt7601u_tx_skb_cb(skb);
+	struct mt76_wcid *wcid = NULL;
+
+	if (!mt7601u_tx_wants_status(info) ||
+	    cb->flags & MT_TX_CB_DMA_FAIL)
+		return false;
+
+	rcu_read_lock();
+	if (cb->wcid < ARRAY_SIZE(dev->wcid))
+		wcid = rcu_dereference(dev->wcid[cb->wcid]);
+	if (wcid) {
+		skb_queue_tail(&wcid->tx_pending, skb);
+		atomic_inc(&dev->tx_pending);
+	}
+	rcu_read_unlock();
 
-	mt7601u_tx_skb_remove_dma_overhead(skb, info);
+	return wcid;
+}
 
-	ieee80211_tx_info_clear_status(info);
-	info->status.rates[0].idx = -1;
-	info->flags |= IEEE80211_TX_STAT_ACK;
+/* Find the pending frame a TX_STAT_FIFO entry belongs to.  Only entries
+ * with a PKT_ID from the status range can belong to a pending frame.
+ */
+struct sk_buff *mt7601u_tx_pending_get(struct mt7601u_dev *dev,
+				       struct mt76_wcid *wcid, u8 pktid)
+{
+	struct sk_buff *skb, *ret = NULL;
+	u8 next, gap = 0;
+
+	if (pktid < MT_PKTID_STATUS)
+		return NULL;
+
+	/* IDs are handed out in sequence, any missing from the FIFO were lost.
+	 * Only the status work consumes the FIFO, no locking needed.
+	 */
+	if (wcid->pktid_last) {
+		next = wcid->pktid_last + 1 - MT_PKTID_STATUS;
+		gap = (pktid - MT_PKTID_STATUS + MT_PKTID_STATUS_N - next) %
+		      MT_PKTID_STATUS_N;
+		dev->tx_status_stats.lost_req_status += gap;
+	}
+	wcid->pktid_last = pktid;
+
+	spin_lock_bh(&wcid->tx_pending.lock);
+	skb_queue_walk(&wcid->tx_pending, skb) {
+		if (mt7601u_tx_skb_cb(skb)->pktid != pktid)
+			continue;
+
+		__skb_unlink(skb, &wcid->tx_pending);
+		atomic_dec(&dev->tx_pending);
+		/* After a gap the ID may have wrapped onto an older frame */
+		if (!gap)
+			mt7601u_tx_lat_update(dev, skb, MT_TX_LAT_STATUS);
+		ret = skb;
+		break;
+	}
+	spin_unlock_bh(&wcid->tx_pending.lock);
+
+	return ret;
+}
+
+static void mt7601u_tx_pending_expire(struct mt7601u_dev *dev)
+{
+	struct ieee80211_tx_info *info;
+	struct mt76_wcid *wcid;
+	struct sk_buff_head list;
+	struct sk_buff *skb;
+	u32 now = mt7601u_tx_stamp();
+	int i;
+
+	if (!atomic_read(&dev->tx_pending))
+		return;
+
+	__skb_queue_head_init(&list);
+
+	rcu_read_lock();
+	for (i = 0; i < ARRAY_SIZE(dev->wcid); i++) {
+		wcid = rcu_dereference(dev->wcid[i]);
+		if (!wcid)
+			continue;
+
+		spin_lock_bh(&wcid->tx_pending.lock);
+		while ((skb = skb_peek(&wcid->tx_pending))) {
+			if (now - mt7601u_tx_skb_cb(skb)->stamp <
+			    MT_TX_STATUS_TIMEOUT * USEC_PER_MSEC)
+				break;
+
+			__skb_unlink(skb, &wcid->tx_pending);
+			__skb_queue_tail(&list, skb);
+			atomic_dec(&dev->tx_pending);
+		}
+		spin_unlock_bh(&wcid->tx_pending.lock);
+	}
+	rcu_read_unlock();
+
+	if (skb_queue_empty(&list))
+		return;
+
+	dev->tx_status_stats.expired += skb_queue_len(&list);
+
+	/* Status got lost, report as not acknowledged */
+	skb_queue_walk(&list, skb) {
+		info = IEEE80211_SKB_CB(skb);
+
+		ieee80211_tx_info_clear_status(info);
+		info->status.rates[0].idx = -1;
+	}
+
+	spin_lock_bh(&dev->mac_lock);
+	while ((skb = __skb_dequeue(&list)))
+		ieee80211_tx_status(dev->hw, skb);
+	spin_unlock_bh(&dev->mac_lock);
+}
+
+/* Must be called after @wcid was unpublished and RCU grace period elapsed. */
+void mt7601u_tx_pending_purge(struct mt7601u_dev *dev, struct mt76_wcid *wcid)
+{
+	struct sk_buff *skb;
+
+	while ((skb = skb_dequeue(&wcid->tx_pending))) {
+		atomic_dec(&dev->tx_pending);
+		dev->tx_status_stats.purged++;
+		ieee80211_free_txskb(dev->hw, skb);
+	}
+}
+
+void mt7601u_tx_status(struct mt7601u_dev *dev, struct sk_buff_head *skbs)
+{
+	struct ieee80211_tx_info *info;
+	struct sk_buff_head done;
+	struct sk_buff *skb;
+
+	__skb_queue_head_init(&done);
+
+	/* Strip DMA overhead from the whole batch first so that mac80211's
+	 * tx status path only has to be locked out once per batch.
+	 */
+	while ((skb = __skb_dequeue(skbs))) {
+		struct mt7601u_tx_cb cb = *mt7601u_tx_skb_cb(skb);
+
+		if (cb.flags & MT_TX_CB_PKTGEN) {
+			mt7601u_pktgen_tx_done(dev, skb);
+			continue;
+		}
+
+		info = IEEE80211_SKB_CB(skb);
+
+		mt7601u_tx_skb_remove_dma_overhead(skb, cb.pkt_len);
+
+		if (mt7601u_tx_pending_add(dev, skb))
+			continue;
+
+		ieee80211_tx_info_clear_status(info);
+		info->status.rates[0].idx = -1;
+		if (!(cb.flags & MT_TX_CB_DMA_FAIL))
+			info->flags |= IEEE80211_TX_STAT_ACK;
+
+		__skb_queue_tail(&done, skb);
+	}
 
 	spin_lock(&dev->mac_lock);
-	ieee80211_tx_status(dev->hw, skb);
+	while ((skb = __skb_dequeue(&done)))
+		ieee80211_tx_status(dev->hw, skb);
 	spin_unlock(&dev->mac_lock);
 }
 
+/* FCE can only checksum plain TCP and UDP over IPv4 and IPv6, it finds the
+ * headers by itself so make sure the stack asked for exactly that.
+ */
+static bool mt7601u_tx_csum_hw_ok(struct sk_buff *skb)
+{
+	u8 proto;
+
+	switch (skb->protocol) {
+	case htons(ETH_P_IP):
+		proto = ip_hdr(skb)->protocol;
+		break;
+	case htons(ETH_P_IPV6):
+		proto = ipv6_hdr(skb)->nexthdr;
+		break;
+	default:
+		return false;
+	}
+
+	switch (proto) {
+	case IPPROTO_TCP:
+		return skb->csum_offset == offsetof(struct tcphdr, check);
+	case IPPROTO_UDP:
+		return skb->csum_offset == offsetof(struct udphdr, check);
+	default:
+		return false;
+	}
+}
+
+/* Returns 1 if checksum should be computed by the HW, 0 if it's done or not
+ * needed and negative error code on failure.
+ */
+static int mt7601u_tx_csum(struct mt7601u_dev *dev, struct sk_buff *skb)
+{
+	if (skb->ip_summed != CHECKSUM_PARTIAL)
+		return 0;
+
+	if (mt7601u_tx_csum_hw_ok(skb)) {
+		atomic_inc(&dev->tx_csum.hw);
+		return 1;
+	}
+
+	atomic_inc(&dev->tx_csum.sw);
+	return skb_checksum_help(skb);
+}
+
+/* mac80211 reserves MT_TX_HEADROOM for us so normally this is a no-op,
+ * count the cases where skb has to be reallocated.
+ */
 static int mt7601u_skb_rooms(struct mt7601u_dev *dev, struct sk_buff *skb)
 {
 	int hdr_len = ieee80211_get_hdrlen_from_skb(skb);
@@ -131,6 +442,13 @@ static int mt7601u_skb_rooms(struct mt7601u_dev *dev, struct sk_buff *skb)
 	if (hdr_len % 4)
 		need_head += 2;
 
+	if (skb_headroom(skb) < need_head)
+		atomic_inc(&dev->tx_slow_path.headroom);
+	else if (skb_cloned(skb))
+		atomic_inc(&dev->tx_slow_path.cloned);
+	else
+		return 0;
+
 	return skb_cow(skb, need_head);
 }
 
@@ -142,25 +460,23 @@ mt7601u_push_txwi(struct mt7601u_dev *dev, struct sk_buff *skb,
 	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
 	struct ieee80211_tx_rate *rate = &info->control.rates[0];
 	struct mt76_txwi *txwi;
-	unsigned long flags;
-	bool is_probe;
-	u32 pkt_id;
+	u32 pkt_id, tx_rate;
 	u16 rate_ctl;
 	u8 nss;
 
 	txwi = (struct mt76_txwi *)skb_push(skb, sizeof(struct mt76_txwi));
 	memset(txwi, 0, sizeof(*txwi));
 
-	if (!wcid->tx_rate_set)
+	tx_rate = READ_ONCE(wcid->tx_rate);
+
+	if (!(tx_rate & MT_WCID_TX_RATE_SET))
 		ieee80211_get_tx_rates(info->control.vif, sta, skb,
 				       info->control.rates, 1);
 
-	spin_lock_irqsave(&dev->lock, flags);
 	if (rate->idx < 0 || !rate->count)
-		rate_ctl = wcid->tx_rate;
+		rate_ctl = MT76_GET(MT_WCID_TX_RATE_VAL, tx_rate);
 	else
 		rate_ctl = mt76_mac_tx_rate_val(dev, rate, &nss);
-	spin_unlock_irqrestore(&dev->lock, flags);
 	txwi->rate_ctl = cpu_to_le16(rate_ctl);
 
 	if (!(info->flags & IEEE80211_TX_CTL_NO_ACK))
@@ -170,24 +486,28 @@ mt7601u_push_txwi(struct mt7601u_dev *dev, struct sk_buff *skb,
 
 	if ((info->flags & IEEE80211_TX_CTL_AMPDU) && sta) {
 		u8 ba_size = IEEE80211_MIN_AMPDU_BUF;
+		u8 density;
 
 		ba_size <<= sta->ht_cap.ampdu_factor;
-		ba_size = min_t(int, 63, ba_size);
+		ba_size = min_t(int, MT_AMPDU_BA_MAX, ba_size);
+		ba_size = min_t(u32, ba_size, READ_ONCE(dev->ampdu.ba_size));
 		if (info->flags & IEEE80211_TX_CTL_RATE_CTRL_PROBE)
 			ba_size = 0;
 		txwi->ack_ctl |= MT76_SET(MT_TXWI_ACK_CTL_BA_WINDOW, ba_size);
 
+		density = max_t(u32, sta->ht_cap.ampdu_density,
+				READ_ONCE(dev->ampdu.density));
+		density = min_t(u8, density, IEEE80211_HT_MPDU_DENSITY_16);
 		txwi->flags = cpu_to_le16(MT_TXWI_FLAGS_AMPDU |
 					  MT76_SET(MT_TXWI_FLAGS_MPDU_DENSITY,
-						   sta->ht_cap.ampdu_density));
+						   density));
 		if (info->flags & IEEE80211_TX_CTL_RATE_CTRL_PROBE)
 			txwi->flags = 0;
 	}
 
 	txwi->wcid = wcid->idx;
 
-	is_probe = !!(info->flags & IEEE80211_TX_CTL_RATE_CTRL_PROBE);
-	pkt_id = mt7601u_tx_pktid_enc(dev, rate_ctl & 0x7, is_probe);
+	pkt_id = mt7601u_tx_pktid_enc(wcid, info, rate_ctl & 0x7);
 	pkt_len |= MT76_SET(MT_TXWI_LEN_PKTID, pkt_id);
 	txwi->len_ctl = cpu_to_le16(pkt_len);
 
@@ -203,21 +523,32 @@ void mt7601u_tx(struct ieee80211_hw *hw, struct ieee80211_tx_control *control,
 	struct ieee80211_sta *sta = control->sta;
 	struct mt76_sta *msta = NULL;
 	struct mt76_wcid *wcid = dev->mon_wcid;
+	struct mt7601u_tx_cb *cb;
 	struct mt76_txwi *txwi;
 	int pkt_len = skb->len;
 	int hw_q = skb2q(skb);
+	u32 stamp = mt7601u_tx_stamp();
+	bool is_probe = info->flags & IEEE80211_TX_CTL_RATE_CTRL_PROBE;
+	int hw_csum;
 
-	BUILD_BUG_ON(ARRAY_SIZE(info->status.status_driver_data) < 1);
-	info->status.status_driver_data[0] = (void *)(unsigned long)pkt_len;
+	hw_csum = mt7601u_tx_csum(dev, skb);
+	if (hw_csum < 0) {
+		ieee80211_free_txskb(dev->hw, skb);
+		return;
+	}
 
 	if (mt7601u_skb_rooms(dev, skb) || mt76_insert_hdr_pad(skb)) {
 		ieee80211_free_txskb(dev->hw, skb);
 		return;
 	}
 
+	atomic_inc(&dev->burst.frames[hw_q]);
+	atomic64_add(pkt_len, &dev->burst.bytes);
+
 	if (sta) {
 		msta = (struct mt76_sta *) sta->drv_priv;
 		wcid = &msta->wcid;
+		atomic_inc(&dev->burst.peer_frames);
 	} else if (vif) {
 		struct mt76_vif *mvif = (struct mt76_vif *)vif->drv_priv;
 
@@ -226,42 +557,270 @@ void mt7601u_tx(struct ieee80211_hw *hw, struct ieee80211_tx_control *control,
 
 	txwi = mt7601u_push_txwi(dev, skb, sta, wcid, pkt_len);
 
+	/* TX control info is not needed any more, cb can be written now */
+	cb = mt7601u_tx_skb_cb(skb);
+	memset(cb, 0, sizeof(*cb));
+	cb->pkt_len = pkt_len;
+	if (hw_csum)
+		cb->flags |= MT_TX_CB_HW_CSUM;
+	if (is_probe)
+		cb->flags |= MT_TX_CB_PROBE;
+	cb->pktid = MT76_GET(MT_TXWI_LEN_PKTID, le16_to_cpu(txwi->len_ctl));
+	cb->rate = le16_to_cpu(txwi->rate_ctl) & 0x7;
+	cb->wcid = wcid->idx;
+	cb->stamp = stamp;
+
 	if (mt7601u_dma_enqueue_tx(dev, skb, wcid, hw_q))
 		return;
 
 	trace_mt_tx(dev, skb, msta, txwi);
 }
 
+/* Queue a frame built by the traffic generator (see pktgen.c).  There is no
+ * mac80211 context for such frames, they are sent at a fixed rate without
+ * asking for ACK or TX status and their completion is consumed by the
+ * generator.  Consumes @skb.
+ */
+int mt7601u_tx_pktgen(struct mt7601u_dev *dev, struct sk_buff *skb,
+		      struct mt76_wcid *wcid, u16 rate_ctl, u8 ac)
+{
+	struct mt7601u_tx_cb *cb = mt7601u_tx_skb_cb(skb);
+	struct mt76_txwi *txwi;
+	int pkt_len = skb->len;
+
+	skb_set_queue_mapping(skb, ac);
+
+	txwi = (struct mt76_txwi *)skb_push(skb, sizeof(struct mt76_txwi));
+	memset(txwi, 0, sizeof(*txwi));
+	txwi->rate_ctl = cpu_to_le16(rate_ctl);
+	txwi->ack_ctl = MT_TXWI_ACK_CTL_NSEQ;
+	txwi->wcid = wcid->idx;
+	txwi->len_ctl = cpu_to_le16(pkt_len);
+
+	memset(cb, 0, sizeof(*cb));
+	cb->pkt_len = pkt_len;
+	cb->flags = MT_TX_CB_PKTGEN;
+	cb->wcid = wcid->idx;
+
+	trace_mt_tx(dev, skb, NULL, txwi);
+
+	skb->tstamp = ktime_get();
+	return mt7601u_dma_enqueue_tx(dev, skb, wcid, q2hwq(ac));
+}
+
+u32 mt7601u_tx_queue_used(struct mt7601u_dev *dev, u8 ac, u32 *entries)
+{
+	return mt7601u_dma_tx_used(dev, q2hwq(ac), entries);
+}
+
+/* Must be called with dev->burst.lock held */
+static void mt7601u_tx_burst_set(struct mt7601u_dev *dev, int hw_q)
+{
+	struct mt7601u_tx_burst *b = &dev->burst;
+	int old_q = b->hw_q;
+
+	WRITE_ONCE(b->hw_q, hw_q);
+	b->switches++;
+
+	if (old_q >= 0)
+		mt76_rmw_field(dev, MT_EDCA_CFG_AC(old_q), MT_EDCA_CFG_TXOP,
+			       b->txop[old_q]);
+	if (hw_q < 0)
+		return;
+
+	/* All TXOP truncation conditions are enabled at init, the burst only
+	 * needs the longer TXOP.
+	 */
+	mt76_rmw_field(dev, MT_EDCA_CFG_AC(hw_q), MT_EDCA_CFG_TXOP,
+		       MT_TX_BURST_TXOP);
+}
+
+/* Called from mac_work.  Give a long TXOP to the busiest queue if a single
+ * peer dominates traffic and retries are low (retry ratio comes from the
+ * A-MPDU tuning loop, which runs just before).  Any sign of contention
+ * drops back to the TXOP mac80211 asked for.
+ */
+void mt7601u_tx_burst_update(struct mt7601u_dev *dev)
+{
+	struct mt7601u_tx_burst *b = &dev->burst;
+	u32 frames[ARRAY_SIZE(b->frames)], peer_frames;
+	u32 total = 0, kbps, *avg;
+	int i, busiest = 0, hw_q = -1;
+	ktime_t now = ktime_get();
+	s64 ms;
+
+	mutex_lock(&b->lock);
+
+	for (i = 0; i < ARRAY_SIZE(b->frames); i++) {
+		frames[i] = atomic_xchg(&b->frames[i], 0);
+		total += frames[i];
+		if (frames[i] > frames[busiest])
+			busiest = i;
+	}
+	peer_frames = atomic_xchg(&b->peer_frames, 0);
+
+	ms = max_t(s64, 1, ktime_ms_delta(now, b->last));
+	kbps = div64_u64(atomic64_xchg(&b->bytes, 0) * 8, ms);
+	avg = b->mode != MT_TX_BURST_OFF && b->hw_q >= 0 ?
+		&b->load_on : &b->load_off;
+	*avg = *avg ? (*avg * 3 + kbps) / 4 : kbps;
+
+	switch (b->mode) {
+	case MT_TX_BURST_OFF:
+		hw_q = 0;
+		break;
+	case MT_TX_BURST_ON:
+		hw_q = total ? busiest : q2hwq(IEEE80211_AC_BE);
+		break;
+	default:
+		if (total >= MT_TX_BURST_MIN_FRAMES &&
+		    peer_frames * 100 >= total * MT_TX_BURST_DOMINANT &&
+		    dev->ampdu.retry_pct <= MT_TX_BURST_RETRY_MAX)
+			hw_q = busiest;
+		break;
+	}
+
+	b->last = now;
+
+	if (hw_q != b->hw_q)
+		mt7601u_tx_burst_set(dev, hw_q);
+
+	mutex_unlock(&b->lock);
+}
+
+void mt7601u_tx_burst_reset(struct mt7601u_dev *dev)
+{
+	struct mt7601u_tx_burst *b = &dev->burst;
+	int i;
+
+	mutex_lock(&b->lock);
+	WRITE_ONCE(b->hw_q, b->mode == MT_TX_BURST_OFF ? 0 : -1);
+	for (i = 0; i < ARRAY_SIZE(b->frames); i++)
+		atomic_set(&b->frames[i], 0);
+	atomic_set(&b->peer_frames, 0);
+	atomic64_set(&b->bytes, 0);
+	b->last = ktime_get();
+	mutex_unlock(&b->lock);
+}
+
+/* Pick the next TX status polling interval.  Aim at reading the FIFO when
+ * it's about half full given the recent rate of status entries, poll as
+ * fast as possible if it was found full.
+ */
+static unsigned long mt7601u_tx_stat_interval(struct mt7601u_dev *dev,
+					      int cleaned)
+{
+	struct mt7601u_tx_stat_poll *p = &dev->tx_stat_poll;
+	ktime_t now = ktime_get();
+	u32 elapsed, rate, interval;
+
+	elapsed = max_t(s64, 1, ktime_to_ms(ktime_sub(now, p->last)));
+	p->last = now;
+
+	rate = (cleaned << MT_TX_STAT_RATE_SHIFT) / elapsed;
+	p->rate = (p->rate * 3 + rate) / 4;
+
+	if (cleaned >= MT_TX_STAT_FIFO_DEPTH) {
+		dev->tx_status_stats.fifo_full++;
+		interval = MT_TX_STAT_POLL_MIN;
+	} else if (!p->rate) {
+		interval = MT_TX_STAT_POLL_MAX;
+	} else {
+		interval = MT_TX_STAT_FIFO_DEPTH / 2;
+		interval = (interval << MT_TX_STAT_RATE_SHIFT) / p->rate;
+	}
+
+	p->interval = clamp_t(u32, interval,
+			      MT_TX_STAT_POLL_MIN, MT_TX_STAT_POLL_MAX);
+
+	return msecs_to_jiffies(p->interval);
+}
+
 void mt7601u_tx_stat(struct work_struct *work)
 {
 	struct mt7601u_dev *dev = container_of(work, struct mt7601u_dev,
 					       stat_work.work);
-	struct mt76_tx_status stat;
-	unsigned long flags;
+	struct mt76_tx_status stat[MT_TX_STAT_FIFO_DEPTH];
+	unsigned long delay;
 	int cleaned = 0;
+	int n;
+
+	do {
+		for (n = 0; n < ARRAY_SIZE(stat); n++) {
+			if (test_bit(MT7601U_STATE_REMOVED, &dev->state))
+				break;
+
+			stat[n] = mt7601u_mac_fetch_tx_status(dev);
+			if (!stat[n].valid)
+				break;
+		}
+
+		if (n)
+			mt76_send_tx_status(dev, stat, n);
+		cleaned += n;
+	} while (n == ARRAY_SIZE(stat));
+	trace_mt_tx_status_cleaned(dev, cleaned);
 
-	while (!test_bit(MT7601U_STATE_REMOVED, &dev->state)) {
-		stat = mt7601u_mac_fetch_tx_status(dev);
-		if (!stat.valid)
-			break;
+	mt7601u_tx_pending_expire(dev);
 
-		mt7601u_tx_pktid_dec(dev, &stat);
-		mt76_send_tx_status(dev, &stat);
+	dev->tx_status_stats.polls++;
+	delay = mt7601u_tx_stat_interval(dev, cleaned);
 
-		cleaned++;
+	/* Keep polling while frames wait for their status */
+	if (cleaned ||
+	    test_and_clear_bit(MT7601U_STATE_MORE_STATS, &dev->state) ||
+	    atomic_read(&dev->tx_pending)) {
+		queue_delayed_work(dev->stat_wq, &dev->stat_work, delay);
+		return;
 	}
-	trace_mt_tx_status_cleaned(dev, cleaned);
 
-	spin_lock_irqsave(&dev->tx_lock, flags);
-	if (cleaned)
-		queue_delayed_work(dev->stat_wq, &dev->stat_work,
-				   msecs_to_jiffies(10));
-	else if (test_and_clear_bit(MT7601U_STATE_MORE_STATS, &dev->state))
-		queue_delayed_work(dev->stat_wq, &dev->stat_work,
-				   msecs_to_jiffies(20));
-	else
-		clear_bit(MT7601U_STATE_READING_STATS, &dev->state);
-	spin_unlock_irqrestore(&dev->tx_lock, flags);
+	clear_bit(MT7601U_STATE_READING_STATS, &dev->state);
+	smp_mb__after_atomic();
+
+	/* TX tasklet may have set MORE_STATS after we checked it but before
+	 * READING_STATS was cleared, in which case it did not queue the work.
+	 */
+	if (test_bit(MT7601U_STATE_MORE_STATS, &dev->state) &&
+	    !test_and_set_bit(MT7601U_STATE_READING_STATS, &dev->state))
+		queue_delayed_work(dev->stat_wq, &dev->stat_work, delay);
+}
+
+void mt7601u_flush(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
+		   u32 queues, bool drop)
+{
+	struct mt7601u_dev *dev = hw->priv;
+	struct mt7601u_flush_stats *st = &dev->flush_stats;
+	ktime_t start = ktime_get();
+	u32 hw_qs = 0, duration;
+	int i, ret;
+
+	if (test_bit(MT7601U_STATE_REMOVED, &dev->state))
+		return;
+
+	for (i = 0; i < hw->queues; i++)
+		if (queues & BIT(i))
+			hw_qs |= BIT(q2hwq(i));
+
+	ret = mt7601u_dma_flush_tx(dev, hw_qs, drop, MT_TX_FLUSH_TIMEOUT);
+
+	/* Rings are empty, make sure statuses from the HW FIFO get reported
+	 * now instead of whenever polling gets to them.
+	 */
+	if (!ret && test_bit(MT7601U_STATE_READING_STATS, &dev->state))
+		flush_delayed_work(&dev->stat_work);
+
+	duration = ktime_us_delta(ktime_get(), start);
+	trace_mt_tx_flush(dev, queues, drop, duration, ret);
+
+	st->n++;
+	st->n_drop += drop;
+	st->n_timeout += !!ret;
+	st->last_us = duration;
+	st->max_us = max(st->max_us, duration);
+	st->total_us += duration;
+
+	if (ret)
+		dev_err(dev->dev, "Error: TX flush timed out\n");
 }
 
 int mt7601u_conf_tx(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
@@ -271,10 +830,6 @@ int mt7601u_conf_tx(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
 	u8 cw_min = 5, cw_max = 10, hw_q = q2hwq(queue);
 	u32 val;
 
-	/* TODO: should we do funny things with the parameters?
-	 *	 See what mt7601u_set_default_edca() used to do in init.c.
-	 */
-
 	if (params->cw_min)
 		cw_min = fls(params->cw_min);
 	if (params->cw_max)
@@ -288,15 +843,15 @@ int mt7601u_conf_tx(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
 	val = MT76_SET(MT_EDCA_CFG_AIFSN, params->aifs) |
 	      MT76_SET(MT_EDCA_CFG_CWMIN, cw_min) |
 	      MT76_SET(MT_EDCA_CFG_CWMAX, cw_max);
-	/* TODO: based on user-controlled EnableTxBurst var vendor drv sets
-	 *	 a really long txop on AC0 (see connect.c:2009) but only on
-	 *	 connect? When not connected should be 0.
-	 */
-	if (!hw_q)
-		val |= 0x60;
+	/* Queue with the long TXOP keeps it, see tx_burst_update */
+	mutex_lock(&dev->burst.lock);
+	dev->burst.txop[hw_q] = params->txop;
+	if (hw_q == dev->burst.hw_q)
+		val |= MT76_SET(MT_EDCA_CFG_TXOP, MT_TX_BURST_TXOP);
 	else
 		val |= MT76_SET(MT_EDCA_CFG_TXOP, params->txop);
 	mt76_wr(dev, MT_EDCA_CFG_AC(hw_q), val);
+	mutex_unlock(&dev->burst.lock);
 
 	val = mt76_rr(dev, MT_WMM_TXOP(hw_q));
 	val &= ~(MT_WMM_TXOP_MASK << MT_WMM_TXOP_SHIFT(hw_q));
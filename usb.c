@@ -103,6 +103,7 @@ int mt7601u_vendor_request(struct mt7601u_dev *dev, const u8 req,
 		usb_rcvctrlpipe(usb_dev, 0) : usb_sndctrlpipe(usb_dev, 0);
 
 	for (i = 0; i < MT_VEND_REQ_MAX_RETRY; i++) {
+		atomic_inc(&dev->usb_xfers);
 		ret = usb_control_msg(usb_dev, pipe, req, req_type,
 				      val, offset, buf, buflen,
 				      MT_VEND_REQ_TOUT_MS);